@@ -4,12 +4,16 @@ set -e
 
 mkdir -p bins
 
-gcc -o master               src/master.c -lcjson -lpthread -lm
-gcc -o bins/Dynamics.out    src/dynamics.c -lm -lpthread
-gcc -o bins/Keyboard.out    src/keyboard.c -lncurses -lpthread
-gcc -o bins/Window.out      src/window.c -lncurses -lpthread -lm
-gcc -o bins/Watchdog.out    src/watchdog.c -lpthread
-gcc -o bins/Obstacle.out    src/obstacle.c -lpthread
-gcc -o bins/Target.out      src/target.c -lpthread
+gcc -o master               src/master.c src/logger.c -lcjson -lpthread -lm
+gcc -o bins/Dynamics.out    src/dynamics.c src/logger.c -O2 -lm -lpthread
+gcc -o bins/Keyboard.out    src/keyboard.c src/logger.c -lncurses -lpthread
+gcc -o bins/Window.out      src/window.c src/logger.c -lncurses -lpthread -lm
+gcc -o bins/Watchdog.out    src/watchdog.c src/logger.c -lpthread
+gcc -o bins/Obstacle.out    src/obstacle.c src/logger.c -lpthread
+gcc -o bins/Target.out      src/target.c src/logger.c -lpthread
+gcc -o batch                src/batch.c src/logger.c -O2 -lcjson -lpthread -lm
+
+# Everything above in one process, components as threads (see readme)
+gcc -o engine -DBB_ENGINE  src/master.c src/dynamics.c src/window.c src/keyboard.c src/watchdog.c src/obstacle.c src/target.c src/logger.c -O2 -lcjson -lncurses -lpthread -lm
 
 echo "Build done. Now run: ./master"
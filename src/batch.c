@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <cjson/cJSON.h>
+#include "blackboard.h"
+#include "object_pool.h"
+#include "physics.h"
+#include "script.h"
+#include "task_pool.h"
+
+// Batch runner: steps many independent drone worlds as fast as the CPU goes,
+// for tuning the physics parameters at scale. No blackboard, no processes:
+// every world is a drone with its own parameters and its own obstacles and
+// targets, driven by one headless script (script.h) and stepped with the same
+// physics.h arithmetic as Dynamics. One CSV line per world on stdout.
+//
+// The hot per-world state (parameters, kinematics, forces) is a structure of
+// arrays. Worlds are stepped in blocks of BATCH_BLOCK: a thread takes a block
+// and runs it through the whole script, one step across all of its worlds at
+// a time, so the integration is a plain loop over arrays the compiler
+// vectorizes. Blocks are the tasks of a work-stealing pool (task_pool.h):
+// worlds never talk to each other, and a thread whose blocks finished early
+// (fewer hits, fewer objects in range) steals the others' remaining ones.
+#define BATCH_BLOCK 64
+#define BATCH_DEFAULT_WORLDS 1024
+
+typedef struct {
+    double lo, hi;          // lo == hi: the same value for every world
+} Range;
+
+typedef struct {
+    int n;
+    int play_w, play_h;
+    int n_obstacles, n_targets;
+    const Script *script;
+
+    // per world
+    double *mass, *damp, *repl, *radius;
+    double *x_i, *x_i_minus_1, *y_i, *y_i_minus_1;
+    double *fx, *fy;
+    int *cell_x, *cell_y;
+    Stats *stats;
+    uint64_t *rng;
+    WorldObjects *objs;
+} Batch;
+
+static double batch_sample(const Range *r, uint64_t *s) {
+    if (r->hi <= r->lo) return r->lo;
+    return r->lo + (r->hi - r->lo) * ((bb_rand(s) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+// "V" or "LO:HI"
+static int parse_range(const char *arg, Range *r) {
+    if (sscanf(arg, "%lf:%lf", &r->lo, &r->hi) == 2) return r->hi >= r->lo ? 0 : -1;
+    if (sscanf(arg, "%lf", &r->lo) == 1) {
+        r->hi = r->lo;
+        return 0;
+    }
+    return -1;
+}
+
+// Defaults from config.json, read the way master does. Returns 0, or -1
+// (already reported on stderr, stdout is the CSV) if there are none.
+static int batch_config(Physix *ph, int *n_obstacles, int *n_targets) {
+    FILE *file = fopen(JSON_PATH, "r");
+    if (!file) {
+        perror("batch: " JSON_PATH);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = malloc(length + 1);
+    if (!data) {
+        perror("Memory allocation failed for JSON config");
+        fclose(file);
+        return -1;
+    }
+    size_t got = fread(data, 1, length, file);
+    data[got] = '\0';
+    fclose(file);
+    cJSON *json = cJSON_Parse(data);
+    if (!json) {
+        fprintf(stderr, "batch: error parsing %s: %s\n", JSON_PATH, cJSON_GetErrorPtr());
+        free(data);
+        return -1;
+    }
+    cJSON *item;
+    if ((item = cJSON_GetObjectItem(json, "num_obstacles")))    *n_obstacles = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "num_targets")))      *n_targets = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "mass")))             ph->mass = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "visc_damp_coef")))   ph->visc_damp_coef = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "obst_repl_coef")))   ph->obst_repl_coef = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "radius")))           ph->radius = item->valueint;
+    cJSON_Delete(json);
+    free(data);
+    return 0;
+}
+
+// A new set of one kind for world w, placed like Obstacle/Target place theirs.
+static int batch_generate(Batch *b, int w, int kind) {
+    ObjectList *l = &b->objs[w].list[kind];
+    int n = (kind == OBJ_OBSTACLES) ? b->n_obstacles : b->n_targets;
+    int play_w = b->play_w, play_h = b->play_h;
+    int max_x = (play_w > 3) ? (play_w - 2) : 1;
+    int max_y = (play_h > 3) ? (play_h - 2) : 1;
+    int use_occ = play_w * play_h <= POOL_OCC_BITS && occ_covers(play_w, play_h, max_x, max_y);
+    if (object_list_reserve(l, n) == -1) return -1;
+    if (use_occ && object_list_reserve_occ(l, play_w, play_h) == -1) return -1;
+    if (use_occ) memset(l->occ, 0, sizeof(uint64_t) * occ_words(play_w, play_h));
+    uint64_t *s = &b->rng[w];
+    for (int i = 0; i < n; i++) {
+        int gen_x, gen_y, tries = 0;
+        do {
+            gen_x = (max_x > 1) ? (int)(bb_rand(s) % max_x + 1) : 1;
+            gen_y = (max_y > 1) ? (int)(bb_rand(s) % max_y + 1) : 1;
+        } while ((gen_x == b->cell_x[w] && gen_y == b->cell_y[w]) ||
+                 (use_occ && ++tries < POOL_PLACE_TRIES && occ_test(l->occ, play_w, gen_x, gen_y)));
+        if (use_occ) occ_set(l->occ, play_w, gen_x, gen_y);
+        l->xs[i] = gen_x;
+        l->ys[i] = gen_y;
+    }
+    l->count = n;
+    l->occ_w = use_occ ? play_w : 0;
+    l->occ_h = use_occ ? play_h : 0;
+    l->version = (l->version == ~0u) ? 1 : l->version + 1;
+    l->hit_for = l->version;    // fresh set: nothing consumed yet
+    memset(l->hit, 0, n);
+    return 0;
+}
+
+// What Dynamics does on a reset: back to the start, objects hidden until the next set.
+static void batch_reset(Batch *b, int w) {
+    b->cell_x[w] = b->cell_y[w] = 2;
+    b->x_i[w] = b->x_i_minus_1[w] = 2;
+    b->y_i[w] = b->y_i_minus_1[w] = 2;
+    memset(&b->stats[w], 0, sizeof(Stats));
+    for (int kind = 0; kind < OBJ_KINDS; kind++) {
+        memset(b->objs[w].list[kind].hit, 1, b->objs[w].list[kind].count);
+    }
+}
+
+// Runs worlds [w0, w1) through the whole script. Returns -1 on OOM.
+static int batch_block(Batch *b, int w0, int w1) {
+    Script sc = *b->script;     // our own cursor
+    BBInput in;
+    memset(&in, 0, sizeof(in));
+    unsigned int reset_epoch = 0;
+    double time_elapsed = 0.0;
+    const long obstacle_every = lround(OBSTACLE_GENERATION_DELAY / DT);
+    const long target_every = lround(TARGET_GENERATION_DELAY / DT);
+
+    for (int w = w0; w < w1; w++) {
+        for (int kind = 0; kind < OBJ_KINDS; kind++) object_list_init(&b->objs[w].list[kind]);
+        force_field_init(&b->objs[w].field);
+        batch_reset(b, w);
+    }
+
+    for (long step = 0; !script_apply(&sc, step, &in); step++) {
+        int reset = in.reset_epoch != reset_epoch;
+        reset_epoch = in.reset_epoch;
+        if (reset) time_elapsed = 0.0;      // the same for every world of the block: kept here, not per world
+        int new_obstacles = step % obstacle_every == 0;
+        int new_targets = step % target_every == 0;
+        int running = in.state != 0;
+
+        for (int w = w0; w < w1; w++) {
+            WorldObjects *objs = &b->objs[w];
+            if (reset) batch_reset(b, w);
+            if (new_obstacles && batch_generate(b, w, OBJ_OBSTACLES) == -1) return -1;
+            if (new_targets && batch_generate(b, w, OBJ_TARGETS) == -1) return -1;
+            if (force_field_update(&objs->field, objs->list, b->play_w, b->play_h, b->radius[w],
+                                   reset || new_obstacles || new_targets) == -1) return -1;
+            Physix ph = { b->mass[w], b->damp[w], b->repl[w], b->radius[w] };
+            b->fx[w] = in.command_force_x;
+            b->fy[w] = in.command_force_y;
+            physics_force(&objs->field, &ph, b->cell_x[w], b->cell_y[w], b->play_w, b->play_h, running, &b->fx[w], &b->fy[w]);
+        }
+        if (running) time_elapsed += DT;
+
+        // The integration itself: straight over the arrays.
+        for (int w = w0; w < w1; w++) {
+            double x_i_new = physics_integrate(b->mass[w], b->damp[w], b->fx[w], b->x_i[w], b->x_i_minus_1[w]);
+            double y_i_new = physics_integrate(b->mass[w], b->damp[w], b->fy[w], b->y_i[w], b->y_i_minus_1[w]);
+            b->x_i_minus_1[w] = b->x_i[w];
+            b->x_i[w] = x_i_new;
+            b->y_i_minus_1[w] = b->y_i[w];
+            b->y_i[w] = y_i_new;
+        }
+
+        for (int w = w0; w < w1; w++) {
+            b->cell_x[w] = b->x_i[w];
+            b->cell_y[w] = b->y_i[w];
+            physics_bounds(&b->cell_x[w], &b->x_i[w], &b->x_i_minus_1[w], b->play_w);
+            physics_bounds(&b->cell_y[w], &b->y_i[w], &b->y_i_minus_1[w], b->play_h);
+            if (physics_hits(&b->objs[w], b->cell_x[w], b->cell_y[w], &b->stats[w], NULL)) {
+                force_field_weights(&b->objs[w].field, b->objs[w].list);
+            }
+            b->stats[w].distance_traveled += physics_moved(b->x_i[w], b->x_i_minus_1[w], b->y_i[w], b->y_i_minus_1[w]);
+        }
+    }
+
+    for (int w = w0; w < w1; w++) {
+        b->stats[w].time_elapsed = time_elapsed;
+        for (int kind = 0; kind < OBJ_KINDS; kind++) {
+            ObjectList *l = &b->objs[w].list[kind];
+            free(l->xs);
+            free(l->ys);
+            free(l->hit);
+            free(l->occ);
+        }
+        grid_free(&b->objs[w].field.grid);
+        free(b->objs[w].field.rep_w);
+        free(b->objs[w].field.att_w);
+        free(b->objs[w].field.src_x);
+        free(b->objs[w].field.src_y);
+        free(b->objs[w].field.chunk_acc);
+    }
+    return 0;
+}
+
+static void batch_task(void *arg, int k) {
+    Batch *b = arg;
+    int w0 = k * BATCH_BLOCK;
+    int w1 = (w0 + BATCH_BLOCK < b->n) ? w0 + BATCH_BLOCK : b->n;
+    if (batch_block(b, w0, w1) == -1) {
+        perror("batch: world allocation failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *script_path = NULL;
+    int n = BATCH_DEFAULT_WORLDS;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long seed = 1;
+    int size_w = 80, size_h = 24;
+    Physix def = {0};
+    int n_obstacles = 0, n_targets = 0;
+    int have_config = batch_config(&def, &n_obstacles, &n_targets) == 0;
+    int given = 0;      // physics parameters set on the command line, one bit each
+    Range mass = { def.mass, def.mass }, damp = { def.visc_damp_coef, def.visc_damp_coef };
+    Range repl = { def.obst_repl_coef, def.obst_repl_coef }, radius = { def.radius, def.radius };
+
+    int bad = 0;
+    for (int i = 1; i < argc && !bad; i++) {
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (argv[i][0] != '-' && !script_path) {
+            script_path = argv[i];
+            continue;
+        }
+        if (!val) {
+            bad = 1;
+        } else if (strcmp(argv[i], "--worlds") == 0) {
+            bad = sscanf(val, "%d", &n) != 1 || n < 1;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            bad = sscanf(val, "%d", &threads) != 1 || threads < 1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            bad = sscanf(val, "%llu", &seed) != 1;
+        } else if (strcmp(argv[i], "--size") == 0) {
+            bad = sscanf(val, "%dx%d", &size_w, &size_h) != 2 || size_w < 1 || size_h < 1;
+        } else if (strcmp(argv[i], "--obstacles") == 0) {
+            bad = sscanf(val, "%d", &n_obstacles) != 1 || n_obstacles < 0;
+        } else if (strcmp(argv[i], "--targets") == 0) {
+            bad = sscanf(val, "%d", &n_targets) != 1 || n_targets < 0;
+        } else if (strcmp(argv[i], "--mass") == 0) {
+            bad = parse_range(val, &mass) == -1;
+            given |= 1;
+        } else if (strcmp(argv[i], "--damp") == 0) {
+            bad = parse_range(val, &damp) == -1;
+            given |= 2;
+        } else if (strcmp(argv[i], "--repl") == 0) {
+            bad = parse_range(val, &repl) == -1;
+            given |= 4;
+        } else if (strcmp(argv[i], "--radius") == 0) {
+            bad = parse_range(val, &radius) == -1;
+            given |= 8;
+        } else {
+            bad = 1;
+        }
+        i++;
+    }
+    if (bad || !script_path) {
+        fprintf(stderr, "usage: %s SCRIPT [--worlds N] [--threads T] [--seed S] [--size WxH] [--obstacles N] [--targets N]\n"
+                        "          [--mass V|LO:HI] [--damp V|LO:HI] [--repl V|LO:HI] [--radius V|LO:HI]\n", argv[0]);
+        return 1;
+    }
+    if (!have_config && given != 15) {
+        // Mass and radius 0 would integrate every world to NaN.
+        fprintf(stderr, "batch: without a config.json, --mass, --damp, --repl and --radius are all needed\n");
+        return 1;
+    }
+    static Script script;
+    if (script_load(script_path, &script) == -1) {
+        return 1;
+    }
+
+    Batch b;
+    memset(&b, 0, sizeof(b));
+    b.n = n;
+    BBWorld world = { .max_width = size_w, .max_height = size_h };
+    b.play_w = bb_play_width(&world);
+    b.play_h = bb_play_height(&world);
+    b.n_obstacles = n_obstacles;
+    b.n_targets = n_targets;
+    b.script = &script;
+    double **arrays[] = { &b.mass, &b.damp, &b.repl, &b.radius, &b.x_i, &b.x_i_minus_1, &b.y_i, &b.y_i_minus_1, &b.fx, &b.fy };
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        *arrays[i] = calloc(n, sizeof(double));
+        if (!*arrays[i]) bad = 1;
+    }
+    b.cell_x = calloc(n, sizeof(int));
+    b.cell_y = calloc(n, sizeof(int));
+    b.stats = calloc(n, sizeof(Stats));
+    b.rng = calloc(n, sizeof(uint64_t));
+    b.objs = calloc(n, sizeof(WorldObjects));
+    if (bad || !b.cell_x || !b.cell_y || !b.stats || !b.rng || !b.objs) {
+        perror("batch: allocation failed");
+        return 1;
+    }
+    // The parameters come from one stream, the objects of world w from its
+    // own: the same seed gives the same worlds whatever the thread count.
+    uint64_t params = seed;
+    for (int w = 0; w < n; w++) {
+        b.mass[w] = batch_sample(&mass, &params);
+        b.damp[w] = batch_sample(&damp, &params);
+        b.repl[w] = batch_sample(&repl, &params);
+        b.radius[w] = batch_sample(&radius, &params);
+        b.rng[w] = seed ^ ((uint64_t)(w + 1) * 0xd1b54a32d192ed03ULL);
+    }
+
+    int blocks = (n + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    if (threads > blocks) threads = blocks;
+    TaskPool pool;
+    if (task_pool_create(&pool, threads) == -1) {
+        perror("batch: task pool creation failed");
+        return 1;
+    }
+    long long started = monotonic_ns();
+    task_pool_run(&pool, blocks, batch_task, &b);
+    double secs = (monotonic_ns() - started) / 1e9;
+    task_pool_destroy(&pool);
+
+    printf("world,mass,visc_damp_coef,obst_repl_coef,radius,score,hits_obstacles,hits_targets,distance,x,y\n");
+    for (int w = 0; w < n; w++) {
+        const Stats *s = &b.stats[w];
+        printf("%d,%.6g,%.6g,%.6g,%.6g,%.2f,%d,%d,%.3f,%d,%d\n", w, b.mass[w], b.damp[w], b.repl[w], b.radius[w],
+               physics_score(s), s->hit_obstacles, s->hit_targets, s->distance_traveled, b.cell_x[w], b.cell_y[w]);
+    }
+    double world_steps = (double)n * script.end_step;
+    fprintf(stderr, "batch: %d worlds x %ld steps (%.3f s simulated) in %.3f s on %d threads, %.1f M world-steps/s\n",
+            n, script.end_step, script.end_step * DT, secs, threads, secs > 0 ? world_steps / secs / 1e6 : 0.0);
+
+    free(script.cmds);
+    return 0;
+}
@@ -8,38 +8,43 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdalign.h>
+#include <sys/syscall.h>
+#include "log_ring.h"
 
 #define SHM_NAME    "/blackboard_shm"
 #define SEM_NAME    "/blackboard_sem"
 #define JSON_PATH   "config.json"
-#define PIPE_BLACKBOARD "/tmp/blackboard_pipe"
-#define PIPE_DYNAMICS   "/tmp/dynamics_pipe"
-#define PIPE_KEYBOARD   "/tmp/keyboard_pipe"
-#define PIPE_WINDOW     "/tmp/window_pipe"
-#define PIPE_OBSTACLE   "/tmp/obstacle_pipe"
-#define PIPE_TARGET     "/tmp/target_pipe"
 #define PIPE_IPCHECK    "/tmp/ipcheck_pipe"
 
-extern pthread_mutex_t logger_mutex;
-static FILE *log_file = NULL;
-pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 #define NUMBER_OF_PROCESSES 6
 #define MAX_MSG_LENGTH 256
 
 // SIMULATION HYPERPARAMETERS
 #define RENDER_DELAY 100000 // microseconds
-#define RETRY_DELAY 50000   // for opening pipes
-#define MAX_RETRIES 20      // for opening pipes
-#define TIMEOUT_SECONDS 10  // for watchdog
+#define RENDER_MAX_DELAY 500000 // microseconds, Window's slowest frame pace (well inside its watchdog deadline)
 
 #define EPSILON 0.0001      // small value to avoid division by zero
 #define DT  0.001           // time step
-#define MAX_OBJECTS 100     // max number of obstacles and targets
+#define MAX_CATCHUP_STEPS 10    // extra physics steps Dynamics may run back to back when late
+#define DEFAULT_MAX_OBJECTS 100 // object pool capacity when config.json has no "max_objects"
 #define BLACKBOARD_CHECK_DELAY      5  // update blackboard every 1 second
 #define OBSTACLE_GENERATION_DELAY   4  // generate obstacles every 4 seconds
 #define TARGET_GENERATION_DELAY     6  // generate targets every 6 seconds
-#define WATCHDOG_HEARTBEAT_DELAY    2  // check heartbeat every 1 second
+
+// Watchdog: one heartbeat slot per monitored component. Each has a progress
+// deadline in ms (config.json "watchdog_deadlines_ms", defaults below): its
+// main loop has to complete an iteration at least that often.
+enum { WD_BLACKBOARD, WD_DYNAMICS, WD_KEYBOARD, WD_WINDOW, WD_OBSTACLE, WD_TARGET, WD_COMPONENTS };
+#define WD_DEFAULT_DEADLINES_MS { 1000, 50, 1000, 1000, 1000, 1000 }
+#define WD_STARTUP_GRACE_MS 5000    // allowed before a component's first iteration
+#define WD_MAX_SLEEP_MS 1000        // the watchdog re-reads deadlines at least this often
+static const char *const WD_NAMES[WD_COMPONENTS] = { "blackboard", "dynamics", "keyboard", "window", "obstacle", "target" };
 
 // ---- UI layout (pdf: full screen + small lateral inspection window) ----
 // The right panel is "just for info"; the playable world stays on the left.
@@ -49,6 +54,13 @@ pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
 // Assignment 3 (pdf): coordinates are exchanged in a virtual system.
 // Most groups use the 100m geo-fence as reference, so we map our grid -> [0..100].
 #define VIRTUAL_WORLD_SIZE 100.0
+#define NET_MAX_PEERS 64    // clients one server takes (swarm sessions)
+// Client jitter buffer: the remote drone is drawn where it was
+// net_interp_delay_ms ago (config.json), interpolated between the received
+// states around that moment, or dead-reckoned past the newest one.
+#define NET_INTERP_SLOTS 16         // received states kept (power of two)
+#define NET_INTERP_DELAY_MS 100     // default render delay
+#define NET_EXTRAP_MAX_MS 250       // dead reckoning stops this far past the newest state
 
 
 // SHARED STRUCTURES and DATA STRUCTURES (with proper order w.r.t padding and memory alignment)
@@ -66,91 +78,397 @@ typedef struct {
     double radius;
 } Physix;
 
+// The blackboard is split into sections, one per writer. Every section starts on
+// its own cache line, so Dynamics publishing the drone at 1 kHz doesn't keep
+// invalidating the lines Window/Obstacle/Target are reading (and vice versa).
+// `seq` is the section's seqlock: odd while its owner is writing, and since it
+// only ever grows it doubles as a version that readers compare to skip copies.
+#define BB_CACHELINE 64
 
-
-typedef struct {
-    Stats stats;
+typedef struct {            // owner: master (config.json + score)
+    alignas(BB_CACHELINE) unsigned int seq;
     Physix physix;
     double score;
-    int state;
-    int n_obstacles;
+    int n_obstacles;        // requested counts; generators publish what they actually placed
     int n_targets;
-    int drone_x, drone_y; 
-    // Assignment 3: remote peer drone position (render-only on the client)
-    int remote_drone_x, remote_drone_y;
+    int max_objects;        // initial object pool capacity
+    int wd_deadline_ms[WD_COMPONENTS];
+    int net_interp_delay_ms;    // client: remote drone render delay, 0 = newest state
+    uint64_t seed;          // the generators' random streams start from it (BB_SEED)
+} BBConfig;
+
+typedef struct {            // owner: master. Geometry of the object pool (object_pool.h)
+    alignas(BB_CACHELINE) unsigned int seq;
+    unsigned int generation;    // bumped on every resize, everybody remaps
+    int chunks;
+    int fd;                     // engine: the pool's memfd, every thread maps its own view
+} BBPool;
+
+typedef struct {            // owner: Dynamics, which applies Keyboard's commands (BBCommands)
+    alignas(BB_CACHELINE) unsigned int seq;
+    int state;              // 0 paused/waiting, 1 running, 3 map view (2, quit, is BBQuit now)
     int command_force_x, command_force_y;
+    unsigned int reset_epoch;   // bumped on every reset, Dynamics applies it
+} BBInput;
+
+typedef struct {            // master, its network thread and Dynamics post a quit -> semaphore
+    alignas(BB_CACHELINE) unsigned int seq;
+    int requested;
+} BBQuit;
+
+// Keyboard -> Dynamics: every key that is a command, in order and stamped with
+// the time it was pressed, taken by Dynamics at its next step. So two keys
+// between steps are both applied, and a reset can't overtake a force change.
+// One producer (Keyboard, or the engine's Window, which gets the keys there)
+// and one consumer, so head and tail are plain counters with acquire/release
+// ordering and nobody takes a lock.
+#define CMD_RING_LEN 256    // power of two
+enum { CMD_FORCE, CMD_BRAKE, CMD_START, CMD_RESET, CMD_MAP, CMD_QUIT };
+
+typedef struct {
+    long long t_ns;         // monotonic ns of the key press
+    int cmd;
+    int dx, dy;             // CMD_FORCE: change of the command force
+} BBCommand;
+
+typedef struct {
+    alignas(BB_CACHELINE) unsigned int head;    // producer
+    unsigned int dropped;                       // producer: commands lost to a full ring
+    alignas(BB_CACHELINE) unsigned int tail;    // Dynamics
+    alignas(BB_CACHELINE) BBCommand ring[CMD_RING_LEN];
+} BBCommands;
+
+typedef struct {            // owner: Window (the network client seeds it before Window starts)
+    alignas(BB_CACHELINE) unsigned int seq;
     int max_height;
     int max_width;
-    int obstacle_xs[MAX_OBJECTS];
-    int obstacle_ys[MAX_OBJECTS];
-    int target_xs[MAX_OBJECTS];
-    int target_ys[MAX_OBJECTS];
-
-    // Tiny bits of extra state so assignment-3 can coordinate window sizing.
-    int win_ready;       // Window has published a sane max_width/max_height
-    int net_lock_size;   // After handshake, freeze max_* even if terminal is resized
+    int win_ready;          // Window has published a sane max_width/max_height
+} BBWorld;
+
+typedef struct {            // owner: Dynamics
+    alignas(BB_CACHELINE) unsigned int seq;
+    int drone_x, drone_y;
+    unsigned int reset_epoch;   // last BBInput.reset_epoch that was applied
+    Stats stats;
+} BBDrone;
+
+enum { OBJ_OBSTACLES = 0, OBJ_TARGETS = 1, OBJ_KINDS = 2 };
+
+typedef struct {            // owner: Obstacle / Target (the network thread on a server)
+    alignas(BB_CACHELINE) unsigned int seq;     // also guards this kind's arrays in the pool
+    int count;
+    int occ_w, occ_h;       // occupancy bitmap geometry, 0 if the publisher has none
+} BBObjects;
+
+typedef struct {            // owner: Dynamics. Objects consumed since the last regeneration
+    alignas(BB_CACHELINE) unsigned int seq;     // also guards the hit masks in the pool
+    unsigned int objects_seq[OBJ_KINDS];        // object versions the masks refer to
+    int count[OBJ_KINDS];
+} BBHits;
+
+typedef struct {
+    long long t_ns;         // monotonic ns of arrival
+    double x, y;            // local cells, not rounded yet
+} BBNetSample;
+
+typedef struct {            // owner: master network thread (Assignment 3)
+    alignas(BB_CACHELINE) unsigned int seq;
+    int remote_drone_x, remote_drone_y;   // remote peer drone position (render-only on the client)
+    unsigned int remote_samples;          // states received so far, the newest NET_INTERP_SLOTS are in remote_hist
+    BBNetSample remote_hist[NET_INTERP_SLOTS];
+    int n_peers;            // client: the other clients of our server (render-only)
+    int peer_xs[NET_MAX_PEERS], peer_ys[NET_MAX_PEERS];
+    int net_lock_size;      // After handshake, freeze max_* even if terminal is resized
+    int net_width, net_height;  // client: the server's size from the handshake (0 before), Window copies it into world
+} BBNet;
+
+// Heartbeat slot, written only by its component (plain atomic stores, no lock
+// and no syscall) and sampled by the watchdog. One cache line each, so a beat
+// never touches a line another process writes.
+typedef struct {
+    alignas(BB_CACHELINE) long long last_progress_ns;  // monotonic ns of the last loop iteration
+    unsigned long long iterations;  // main-loop iterations so far
+    long long idle_until_ns;        // in heartbeat_sleep(): no progress expected before this
+    int pid;                        // thread id (the pid for a component process); 0: not started yet, -1: closed (not watched anymore)
+} BBHeartbeat;
+
+typedef struct {
+    BBConfig config;
+    BBPool pool;
+    BBInput input;
+    BBQuit quit;
+    BBCommands commands;
+    BBWorld world;
+    BBDrone drone;
+    BBObjects objects[OBJ_KINDS];   // positions themselves are in the object pool
+    BBHits hits;
+    BBNet net;
+    BBHeartbeat heartbeat[WD_COMPONENTS];
 } newBlackboard;
 
-static inline int bb_inspection_width(const newBlackboard *bb) {
+// Component entry points. Each component's main() maps the shared blackboard
+// and calls its *_run(); the single-binary engine (master.c built with
+// -DBB_ENGINE) runs them as threads on one in-process blackboard instead.
+int window_run(newBlackboard *bb, sem_t *sem);
+int dynamics_run(newBlackboard *bb, sem_t *sem);
+int keyboard_run(newBlackboard *bb, sem_t *sem);
+int keyboard_key(newBlackboard *bb, int ch);
+int watchdog_run(newBlackboard *bb, sem_t *sem);
+int obstacle_run(newBlackboard *bb, sem_t *sem);
+int target_run(newBlackboard *bb, sem_t *sem);
+
+static inline int bb_inspection_width(const BBWorld *world) {
     // Keep it reasonable on small terminals.
-    if (bb->max_width < INSPECTION_WIDTH + 20) return 0;
+    if (world->max_width < INSPECTION_WIDTH + 20) return 0;
     return INSPECTION_WIDTH;
 }
 
-// We store the full window size into bb->max_*; the playable area is the left part.
-static inline int bb_play_width(const newBlackboard *bb) {
-    int insp = bb_inspection_width(bb);
-    int play = bb->max_width - insp;
-    if (play < 10) play = bb->max_width;
+// We store the full window size into world->max_*; the playable area is the left part.
+static inline int bb_play_width(const BBWorld *world) {
+    int insp = bb_inspection_width(world);
+    int play = world->max_width - insp;
+    if (play < 10) play = world->max_width;
     return play;
 }
 
-static inline int bb_play_height(const newBlackboard *bb) {
-    return bb->max_height;
+static inline int bb_play_height(const BBWorld *world) {
+    return world->max_height;
 }
 
-
-// COMMON FUNCTIONS
-static inline void logger(const char *format, ...) {
-    if (!log_file) {
-        log_file = fopen("./logs/simulation.log", "a");
-        if (!log_file) {
-            perror("Unable to open log file");
-            return;
+// Remote drone at time t from the jitter buffer. Returns 0 if nothing arrived yet.
+static inline int bb_remote_at(const BBNet *net, long long t, double *x, double *y) {
+    unsigned int n = net->remote_samples;
+    if (n == 0) return 0;
+    unsigned int count = (n < NET_INTERP_SLOTS) ? n : NET_INTERP_SLOTS;
+    const BBNetSample *b = &net->remote_hist[(n - 1) & (NET_INTERP_SLOTS - 1)];
+    *x = b->x;
+    *y = b->y;
+    if (t >= b->t_ns) {     // past the newest: keep its last velocity for a while
+        if (count < 2) return 1;
+        const BBNetSample *a = &net->remote_hist[(n - 2) & (NET_INTERP_SLOTS - 1)];
+        long long ahead = t - b->t_ns;
+        if (ahead > NET_EXTRAP_MAX_MS * 1000000LL) ahead = NET_EXTRAP_MAX_MS * 1000000LL;
+        if (b->t_ns > a->t_ns) {
+            double k = (double)ahead / (double)(b->t_ns - a->t_ns);
+            *x += (b->x - a->x) * k;
+            *y += (b->y - a->y) * k;
         }
+        return 1;
+    }
+    for (unsigned int i = 1; i < count; i++) {     // newest pair first
+        const BBNetSample *a = &net->remote_hist[(n - 1 - i) & (NET_INTERP_SLOTS - 1)];
+        b = &net->remote_hist[(n - i) & (NET_INTERP_SLOTS - 1)];
+        if (t < a->t_ns) continue;
+        double k = (b->t_ns > a->t_ns) ? (double)(t - a->t_ns) / (double)(b->t_ns - a->t_ns) : 1.0;
+        *x = a->x + (b->x - a->x) * k;
+        *y = a->y + (b->y - a->y) * k;
+        return 1;
+    }
+    const BBNetSample *oldest = &net->remote_hist[(n - count) & (NET_INTERP_SLOTS - 1)];
+    *x = oldest->x;     // older than everything we kept
+    *y = oldest->y;
+    return 1;
+}
+
+// ---- Seqlock ----
+// Each section has exactly one owner, which writes it without any lock. The one
+// exception is quit (master, Dynamics on a keyboard quit, the network thread):
+// its writers serialize on the named semaphore, see bb_quit(). Readers never
+// block: they copy and retry if the owner was active in the meantime. Never do
+// anything slow (I/O, logging) inside a write section.
+static inline void seq_write_begin(unsigned int *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);   // data stores may not move above the odd seq
+}
+
+static inline void seq_write_end(unsigned int *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline unsigned int seq_read_begin(const unsigned int *seq) {
+    unsigned int s;
+    while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1u) {
+        sched_yield();  // writer is mid-update (or got preempted there), let it finish
+    }
+    return s;
+}
+
+static inline int seq_read_retry(const unsigned int *seq, unsigned int start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline unsigned int seq_version(const unsigned int *seq) {
+    return __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+}
+
+// Copy a whole section (seq included). Returns the version that was copied.
+static inline unsigned int seq_copy(const unsigned int *seq, void *dst, const void *src, size_t n) {
+    unsigned int s;
+    do {
+        s = seq_read_begin(seq);
+        memcpy(dst, src, n);
+    } while (seq_read_retry(seq, s));
+    return s;
+}
+
+// Same, but skip the copy when the section is still at version *seen.
+static inline int seq_copy_if_changed(const unsigned int *seq, unsigned int *seen, void *dst, const void *src, size_t n) {
+    if (seq_version(seq) == *seen) return 0;
+    *seen = seq_copy(seq, dst, src, n);
+    return 1;
+}
+
+// Overwrite everything but the seq header with a private copy of the section.
+static inline void seq_publish(unsigned int *seq, void *dst, const void *src, size_t n) {
+    seq_write_begin(seq);
+    memcpy((char *)dst + sizeof(*seq), (const char *)src + sizeof(*seq), n - sizeof(*seq));
+    seq_write_end(seq);
+}
+
+#define BB_READ(sec, out)                   seq_copy(&(sec)->seq, &(out), (sec), sizeof(*(sec)))
+#define BB_READ_IF_CHANGED(sec, out, seen)  seq_copy_if_changed(&(sec)->seq, &(seen), &(out), (sec), sizeof(*(sec)))
+#define BB_WRITE_BEGIN(sec)                 seq_write_begin(&(sec)->seq)
+#define BB_WRITE_END(sec)                   seq_write_end(&(sec)->seq)
+#define BB_PUBLISH(sec, local)              seq_publish(&(sec)->seq, (sec), &(local), sizeof(*(sec)))
+
+// Quit is the only multi-writer section: writers serialize on the semaphore.
+static inline void bb_quit(newBlackboard *bb, sem_t *sem) {
+    sem_wait(sem);
+    BB_WRITE_BEGIN(&bb->quit);
+    bb->quit.requested = 1;
+    BB_WRITE_END(&bb->quit);
+    sem_post(sem);
+}
+
+static inline int bb_quit_requested(const newBlackboard *bb) {
+    BBQuit q;
+    BB_READ(&bb->quit, q);
+    return q.requested;
+}
+
+// Producer side. Returns -1 (and counts it) if Dynamics is that far behind.
+static inline int bb_command_push(BBCommands *q, const BBCommand *c) {
+    unsigned int head = q->head;
+    if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) >= CMD_RING_LEN) {
+        q->dropped++;
+        return -1;
     }
-    pthread_mutex_lock(&logger_mutex);
-    time_t now = time(NULL);
-    char time_str[20];
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    fprintf(log_file, "[%s] ", time_str);
-    va_list args;
-    va_start(args, format);
-    vfprintf(log_file, format, args);
-    va_end(args);
-    fprintf(log_file, "\n");
-    fflush(log_file);
-    pthread_mutex_unlock(&logger_mutex);
-}
-
-int open_watchdog_pipe(const char *pipe_name) {
-    int fd, retries = 0;
-    while ((fd = open(pipe_name, O_RDWR | O_NONBLOCK)) < 0 && retries < MAX_RETRIES) {
-        if (errno == ENOENT) {  // FIFO does not exist yet
-            usleep(RETRY_DELAY);  // Wait and retry
-            retries++;
-        } else {
-            perror("Failed to open watchdog pipe");
-            return -1;
+    q->ring[head & (CMD_RING_LEN - 1)] = *c;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Consumer side: 1 and the oldest command, or 0 if there is none.
+static inline int bb_command_pop(BBCommands *q, BBCommand *c) {
+    unsigned int tail = q->tail;
+    if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) return 0;
+    *c = q->ring[tail & (CMD_RING_LEN - 1)];
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// What a command does to the input (Keyboard's old key handling). Returns 1
+// for a quit, which the caller posts.
+static inline int bb_command_apply(BBInput *in, const BBCommand *c) {
+    switch (c->cmd) {
+    case CMD_FORCE:
+        in->command_force_x += c->dx;
+        in->command_force_y += c->dy;
+        break;
+    case CMD_BRAKE:
+        in->command_force_x = 0;
+        in->command_force_y = 0;
+        break;
+    case CMD_START:
+        in->state = 1;
+        break;
+    case CMD_RESET:     // Dynamics starts the drone and stats over on the new epoch
+        in->state = 0;
+        in->command_force_x = 0;
+        in->command_force_y = 0;
+        in->reset_epoch++;
+        break;
+    case CMD_MAP:
+        if (in->state == 1) {
+            in->state = 3;
+        } else if (in->state == 3) {
+            in->state = 1;
         }
+        break;
+    case CMD_QUIT:
+        return 1;
     }
-    return fd; 
+    return 0;
+}
+
+// Section-by-section copy of the whole blackboard. Every section is consistent on
+// its own; there is no global atomicity across sections (nobody needs it).
+static inline void bb_snapshot(const newBlackboard *bb, newBlackboard *out) {
+    BB_READ(&bb->config, out->config);
+    BB_READ(&bb->input, out->input);
+    BB_READ(&bb->quit, out->quit);
+    BB_READ(&bb->world, out->world);
+    BB_READ(&bb->drone, out->drone);
+    BB_READ(&bb->pool, out->pool);
+    BB_READ(&bb->objects[OBJ_OBSTACLES], out->objects[OBJ_OBSTACLES]);
+    BB_READ(&bb->objects[OBJ_TARGETS], out->objects[OBJ_TARGETS]);
+    BB_READ(&bb->hits, out->hits);
+    BB_READ(&bb->net, out->net);
+}
+
+
+// COMMON FUNCTIONS
+static inline long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// splitmix64: tiny, and a different seed gives an independent stream. The
+// generators and batch draw from it instead of rand(), so a seed pins them down.
+static inline uint64_t bb_rand(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// logger() itself lives in log_ring.h (asynchronous, no syscalls on the caller).
+
+// Marks progress of a component's main loop in its heartbeat slot. A tick is
+// two stores into our own cache line, so call heartbeat_tick() every iteration.
+typedef struct {
+    BBHeartbeat *slot;      // NULL: not watched (network mode), ticks do nothing
+    int component;          // WD_*
+} Heartbeat;
+
+static inline void heartbeat_open(Heartbeat *hb, newBlackboard *bb, int component) {
+    hb->slot = &bb->heartbeat[component];
+    hb->component = component;
+    __atomic_store_n(&hb->slot->pid, (int)syscall(SYS_gettid), __ATOMIC_RELEASE);
+}
+
+static inline void heartbeat_tick(Heartbeat *hb) {
+    if (!hb->slot) return;
+    __atomic_store_n(&hb->slot->iterations, hb->slot->iterations + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hb->slot->last_progress_ns, monotonic_ns(), __ATOMIC_RELEASE);
+}
+
+// sleep() replacement for components that idle for seconds between work: the
+// watchdog won't expect progress before the sleep is over. Like sleep() it
+// returns early when a signal arrives.
+static inline void heartbeat_sleep(Heartbeat *hb, long long ns) {
+    long long until = monotonic_ns() + ns;
+    if (hb->slot) __atomic_store_n(&hb->slot->idle_until_ns, until, __ATOMIC_RELEASE);
+    struct timespec ts = { (time_t)(until / 1000000000LL), (long)(until % 1000000000LL) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    heartbeat_tick(hb);
 }
 
-void send_heartbeat(int fd) {
-    if (write(fd, "HB", 2) < 0){
-        perror("Failed to write to watchdog pipe");
-    };
+static inline void heartbeat_close(Heartbeat *hb) {
+    if (hb->slot) __atomic_store_n(&hb->slot->pid, -1, __ATOMIC_RELEASE);
+    hb->slot = NULL;
 }
 
 #endif 
@@ -11,13 +11,50 @@
 #include <time.h>
 #include <stdbool.h>
 #include "blackboard.h"
-#include "logger.h"
+#include "object_pool.h"
+#include "force_kernel.h"
+#include "physics.h"
+#include "script.h"
+#include "recorder.h"
 
 
-void compute_repulsive_force(double *Fx, double *Fy, newBlackboard *bb);
-void compute_attractive_force(double *Fx, double *Fy, newBlackboard *bb);
+// Drone state carried from one step to the next (current and previous position).
+typedef struct {
+    double x_i, x_i_minus_1;
+    double y_i, y_i_minus_1;
+} Kinematics;
 
+// Last version seen of each section we only read.
+typedef struct {
+    unsigned int config, world;
+} SeenVersions;
 
+// What one step changed, so logging/publishing can happen outside of it.
+typedef struct {
+    int hits_dirty;
+} StepResult;
+
+// A recording being played back (BB_REPLAY) instead of the blackboard's input.
+typedef struct {
+    RecReader rd;
+    const RecStep *steps;   // the recorded run of steps we are in
+    int n_steps, next;
+    long mismatches;
+    long first_bad;         // step of the first mismatch, -1 if none
+} Replay;
+
+static int sync_sections(newBlackboard *bb, newBlackboard *vb, ObjectPool *pool, SeenVersions *seen, Kinematics *k, WorldObjects *objs,
+                         Recorder *rec, long step);
+static int replay_sync(Replay *rp, long step, newBlackboard *vb, Kinematics *k, WorldObjects *objs, int *hits_dirty);
+static int apply_reset(newBlackboard *vb, Kinematics *k, WorldObjects *objs);
+static uint32_t step_check(const newBlackboard *vb, const Kinematics *k);
+static void take_commands(newBlackboard *bb, sem_t *sem, BBInput *in, Recorder *rec, long step);
+static void update_field(newBlackboard *vb, WorldObjects *objs, int hits_dirty);
+static void physics_step(newBlackboard *vb, Kinematics *k, WorldObjects *objs, StepResult *res, HitQueue *hq);
+static void drain_hits(HitQueue *hq);
+
+
+#ifndef BB_ENGINE
 int main() {
     const char *shm_name = getenv("BB_SHM_NAME");
     if (!shm_name) shm_name = SHM_NAME;
@@ -33,169 +70,391 @@ int main() {
     }
     const char *sem_name = getenv("BB_SEM_NAME");
     if (!sem_name) sem_name = SEM_NAME;
-    sem_t *sem = sem_open(sem_name, 0);
+    sem_t *sem = sem_open(sem_name, 0);     // only to post a quit from the keyboard
     if (sem == SEM_FAILED) {
         perror("sem_open failed");
         return 1;
     }
-    int fd = open_watchdog_pipe(PIPE_DYNAMICS);
+    int rc = dynamics_run(bb, sem);
+    sem_close(sem);
+    munmap(bb, sizeof(newBlackboard));
+    return rc;
+}
+#endif
+
+int dynamics_run(newBlackboard *bb, sem_t *sem) {
+    ObjectPool pool;
+    if (pool_open(&pool, bb) == -1) {
+        perror("object pool open failed");
+        return 1;
+    }
+    static Script script;
+    const char *script_path = getenv("BB_SCRIPT");
+    if (script_path) {
+        if (script_load(script_path, &script) == -1) return 1;
+        logger("Dynamics: running script %s, %d commands, %.3f s", script_path, script.n, script.end_step * DT);
+    }
+    // BB_REPLAY: play a recording back (master --replay) and check every step.
+    static Replay replay;
+    const char *replay_path = getenv("BB_REPLAY");
+    if (replay_path) {
+        if (rec_read_open(&replay.rd, replay_path) == -1) return 1;
+        replay.first_bad = -1;
+        logger("Dynamics: replaying %s (seed %llu)", replay_path, (unsigned long long)replay.rd.hdr.seed);
+    }
+    // BB_FAST: no pacing, every step runs as soon as the previous one is done.
+    int fast = (getenv("BB_FAST") != NULL);
+    // BB_WAIT_OBJECTS: the generators' first sets are part of the run, don't
+    // start without them (a fast run could be over before they show up).
+    if (getenv("BB_WAIT_OBJECTS")) {
+        while (seq_version(&bb->objects[OBJ_OBSTACLES].seq) == 0 || seq_version(&bb->objects[OBJ_TARGETS].seq) == 0) {
+            usleep(1000);
+        }
+    }
+    // Dynamics owns the input, drone and hits sections: the semaphore is only
+    // for posting a quit somebody typed.
+    Heartbeat hb;
+    heartbeat_open(&hb, bb, WD_DYNAMICS);
     logger("Dynamics started. PID: %d", getpid());
 
-    double vx = 0, vy = 0;
-    double Fx, Fy, repulsive_Fx, repulsive_Fy, attractive_Fx=0, attractive_Fy=0;
-    double x_i = bb->drone_x, x_i_minus_1 = bb->drone_x, x_i_new;
-    double y_i = bb->drone_y, y_i_minus_1 = bb->drone_y, y_i_new;
+    // Private view of the blackboard. Sections written by others are refreshed
+    // only when their version moves; drone/hits are ours and get published.
+    static newBlackboard view;
+    newBlackboard *vb = &view;
+    SeenVersions seen;
+    memset(&seen, 0xff, sizeof(seen));
+    bb_snapshot(bb, vb);
+
+    static WorldObjects objs;
+    for (int kind = 0; kind < OBJ_KINDS; kind++) {
+        object_list_init(&objs.list[kind]);
+    }
+    force_field_init(&objs.field);
+    if (replay_path && objs.field.par_min != replay.rd.hdr.par_min) {
+        // Chunked and plain sums round differently: sum the way the recording did.
+        log_at(LOG_WARN, "Dynamics: force sums chunked from %d slots, as recorded (not %d)", replay.rd.hdr.par_min, objs.field.par_min);
+        objs.field.par_min = replay.rd.hdr.par_min;
+    }
+    logger("Dynamics: %s force kernel", objs.field.impl);
+    // Dense worlds spread the force sum over a task pool (BB_THREADS threads,
+    // default one per CPU). Below par_min slots around the drone it stays on
+    // this thread, and the pool's threads sleep.
+    static TaskPool tasks;
+    const char *env_threads = getenv("BB_THREADS");
+    int threads = env_threads ? atoi(env_threads) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > 1) {
+        if (task_pool_create(&tasks, threads) == -1) {
+            log_at(LOG_WARN, "Dynamics: task pool creation failed, force sums stay serial");
+        } else {
+            objs.field.pool = &tasks;
+            logger("Dynamics: %d threads for force sums from %d slots in range", threads, objs.field.par_min);
+        }
+    }
+
+    Kinematics k;
+    k.x_i = k.x_i_minus_1 = vb->drone.drone_x;
+    k.y_i = k.y_i_minus_1 = vb->drone.drone_y;
+
+    // BB_RECORD: record the session (master --record). Config, world and
+    // objects follow on the first sync, as they are read.
+    static Recorder rec;
+    const char *rec_path = getenv("BB_RECORD");
+    if (rec_path && !replay_path) {
+        if (rec_open(&rec, rec_path, vb->config.seed, objs.field.par_min) == -1) return 1;
+        rec_event(&rec, REC_DRONE, 0, &vb->drone, sizeof(vb->drone));
+        rec_event(&rec, REC_INPUT, 0, &vb->input, sizeof(vb->input));
+        logger("Dynamics: recording to %s (seed %llu)", rec_path, (unsigned long long)vb->config.seed);
+    }
+
+    // Fixed timestep against absolute monotonic deadlines: step i is due at
+    // start + i*DT no matter how long the previous one took, so simulated time
+    // doesn't drift from wall time. If we wake up late we run the missed steps
+    // back to back (at most MAX_CATCHUP_STEPS), anything beyond that is dropped.
+    const long long period_ns = (long long)(DT * 1e9);
+    long long deadline = monotonic_ns();
+    long long late_sum = 0, late_max = 0;
+    long steps = 0, catchup = 0, dropped = 0;
+    long sim_steps = 0;     // since start, what the script counts in
+    long long started = deadline;
     time_t now = time(NULL);
+    static HitQueue hq;
 
     while (1){
-        sem_wait(sem);
-
-        Fx = bb->command_force_x;
-        Fy = bb->command_force_y;
-        repulsive_Fx = 0.0, repulsive_Fy = 0.0;
-        attractive_Fx = 0.0, attractive_Fy = 0.0;
-        if (bb->state != 0){  // only calculate these when running. the rest of the loop doesn't matter because they WILL be 0
-            compute_repulsive_force(&repulsive_Fx, &repulsive_Fy, bb);
-            compute_attractive_force(&attractive_Fx, &attractive_Fy, bb);
-        }
-        Fx += repulsive_Fx + attractive_Fx;
-        Fy += repulsive_Fy + attractive_Fy;
-
-        x_i_new = (1/(bb->physix.mass+bb->physix.visc_damp_coef*DT)) * (Fx * DT * DT - bb->physix.mass * (x_i_minus_1-2*x_i) + bb->physix.visc_damp_coef * DT * x_i);
-        y_i_new = (1/(bb->physix.mass+bb->physix.visc_damp_coef*DT)) * (Fy * DT * DT - bb->physix.mass * (y_i_minus_1-2*y_i) + bb->physix.visc_damp_coef * DT * y_i);
-        bb->drone_x = x_i_new;
-        bb->drone_y = y_i_new;
-        x_i_minus_1 = x_i;
-        x_i = x_i_new;
-        y_i_minus_1 = y_i;
-        y_i = y_i_new;
-
-        int play_w = bb_play_width(bb);
-        int play_h = bb_play_height(bb);
-
-        if (bb->drone_x < 1) {
-            bb->drone_x = 1;
-            x_i = bb->drone_x;
-            x_i_minus_1 = bb->drone_x;
-            vx = 0; Fx = 0;
-        }
-        if (bb->drone_x > play_w-1) {
-            bb->drone_x = play_w-2;
-            x_i = bb->drone_x;
-            x_i_minus_1 = bb->drone_x;
-            vx = 0; Fx = 0;
-        }
-        if (bb->drone_y < 1) {
-            bb->drone_y = 1;
-            y_i = bb->drone_y;
-            y_i_minus_1 = bb->drone_y;
-            vy = 0; Fy = 0;
-        }
-        if (bb->drone_y > play_h-1) {
-            bb->drone_y = play_h-2;
-            y_i = bb->drone_y;
-            y_i_minus_1 = bb->drone_y;
-            vy = 0; Fy = 0;
+        long long wake = (fast || replay_path) ? deadline : monotonic_ns();     // a replay never catches up: its steps are the recorded ones
+        int hits_dirty;
+        if (replay_path) {
+            if (!replay_sync(&replay, sim_steps, vb, &k, &objs, &hits_dirty)) break;
+        } else {
+            if (script.cmds) {
+                BBInput before = vb->input;
+                if (script_apply(&script, sim_steps, &vb->input)) break;
+                if (memcmp(&before, &vb->input, sizeof(before)) != 0) {
+                    rec_event(&rec, REC_INPUT, sim_steps, &vb->input, sizeof(vb->input));
+                }
+            } else {
+                take_commands(bb, sem, &vb->input, &rec, sim_steps);
+            }
+            hits_dirty = sync_sections(bb, vb, &pool, &seen, &k, &objs, &rec, sim_steps);
         }
+        update_field(vb, &objs, hits_dirty);
+
+        int substeps = 0;
+        do {
+            long long late = wake - deadline;
+            late_sum += late;
+            if (late > late_max) late_max = late;
 
-        for (int i=0; i<bb->n_obstacles; i++){ // TODO MAYBE MERGE WITH OTHER LOOPS
-            if (bb->drone_x == bb->obstacle_xs[i] && bb->drone_y == bb->obstacle_ys[i]){
-                bb->stats.hit_obstacles += 1;
-                bb->obstacle_xs[i] = -1;
-                bb->obstacle_ys[i] = -1;
-                logger("Drone hit an obstacle at position (%d, %d)", bb->drone_x, bb->drone_y);
+            StepResult res = {hits_dirty};
+            physics_step(vb, &k, &objs, &res, &hq);
+            uint32_t check = (rec.map || replay_path) ? step_check(vb, &k) : 0;
+            rec_step(&rec, sim_steps, vb->drone.drone_x, vb->drone.drone_y, check);
+            if (replay_path) {
+                const RecStep *want = &replay.steps[replay.next - 1];
+                if (want->check != check || want->x != vb->drone.drone_x || want->y != vb->drone.drone_y) {
+                    if (replay.mismatches++ == 0) {
+                        replay.first_bad = sim_steps;
+                        log_at(LOG_ERROR, "Dynamics: replay differs at step %ld: (%d, %d) recorded, (%d, %d) now",
+                                          sim_steps, want->x, want->y, vb->drone.drone_x, vb->drone.drone_y);
+                    }
+                }
             }
-        }
-        for (int i=0; i<bb->n_targets; i++){
-            if (bb->drone_x == bb->target_xs[i] && bb->drone_y == bb->target_ys[i]){
-                bb->stats.hit_targets += 1;
-                bb->target_xs[i] = -1;
-                bb->target_ys[i] = -1;
-                logger("Drone got a target at position (%d, %d)", bb->drone_x, bb->drone_y);
+            if (res.hits_dirty) {
+                pool_publish_hits(&pool, bb, objs.list);
+                force_field_weights(&objs.field, objs.list);
             }
+            BB_PUBLISH(&bb->drone, vb->drone);
+            hits_dirty = 0;
+
+            deadline += period_ns;
+            substeps++;
+            steps++;
+            sim_steps++;
+        } while (deadline <= wake && substeps <= MAX_CATCHUP_STEPS);
+        catchup += substeps - 1;
+        if (deadline <= wake) {
+            long long missed = (wake - deadline) / period_ns + 1;
+            dropped += missed;
+            deadline += missed * period_ns;
         }
-        if (x_i != x_i_minus_1 || y_i != y_i_minus_1){  
-            bb->stats.distance_traveled += sqrt((x_i - x_i_minus_1) * (x_i - x_i_minus_1) + (y_i - y_i_minus_1) * (y_i - y_i_minus_1));
-        }
-        sem_post(sem);
+        drain_hits(&hq);
+        heartbeat_tick(&hb);     // one loop iteration = progress for the watchdog
+
         if (difftime(time(NULL), now) >= 3){
-            send_heartbeat(fd);
+            logger("Dynamics timing: %ld steps, lateness avg %.1f us max %.1f us, %ld catch-up, %ld dropped",
+                   steps, steps ? late_sum / 1000.0 / steps : 0.0, late_max / 1000.0, catchup, dropped);
+            late_sum = late_max = 0;
+            steps = catchup = dropped = 0;
             now = time(NULL);
         }
-        usleep(DT * 1000000);
+
+        if (fast) continue;
+        struct timespec ts = { (time_t)(deadline / 1000000000LL), (long)(deadline % 1000000000LL) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
     }
-    if (fd >= 0) { close(fd); }
-    munmap(bb, sizeof(newBlackboard));
-    return 0;
+    logger("Dynamics: %s done, %ld steps (%.3f s simulated in %.3f s)", replay_path ? "replay" : "script",
+           sim_steps, sim_steps * DT, (monotonic_ns() - started) / 1e9);
+    int rc = 0;
+    if (replay_path) {
+        if (replay.mismatches) {
+            fprintf(stderr, "replay: %ld of %ld steps differ from the recording, the first at step %ld\n",
+                    replay.mismatches, sim_steps, replay.first_bad);
+            rc = 1;
+        } else {
+            logger("Dynamics: replay matches the recording bit for bit");
+        }
+        rec_read_close(&replay.rd);
+    }
+    rec_close(&rec);
+    free(script.cmds);
+    if (objs.field.pool) task_pool_destroy(&tasks);
+    heartbeat_close(&hb);
+    pool_close(&pool);
+    return rc;
 }
 
-void compute_repulsive_force(double *Fx, double *Fy, newBlackboard *bb) {
-    *Fx = 0;
-    *Fy = 0;
-    double dx, dy, dist, repulsive;
+// Refresh the sections other processes changed and apply a pending reset.
+// Whatever changed is recorded at this step. Returns 1 if the hit masks
+// changed and must be republished.
+static int sync_sections(newBlackboard *bb, newBlackboard *vb, ObjectPool *pool, SeenVersions *seen, Kinematics *k, WorldObjects *objs,
+                         Recorder *rec, long step) {
+    static int pool_failed;     // logged once per streak of failed reads
+    int hits_dirty = 0;
+    if (BB_READ_IF_CHANGED(&bb->config, vb->config, seen->config)) {
+        rec_event(rec, REC_CONFIG, step, &vb->config, sizeof(vb->config));
+    }
+    if (BB_READ_IF_CHANGED(&bb->world, vb->world, seen->world)) {
+        rec_event(rec, REC_WORLD, step, &vb->world, sizeof(vb->world));
+    }
+    for (int kind = 0; kind < OBJ_KINDS; kind++) {
+        ObjectList *l = &objs->list[kind];
+        int rc = pool_read_objects(pool, bb, kind, l);
+        if (rc == -1) {
+            // The list still holds the previous set: go on with it and try
+            // again next step, a remap or allocation may well work then.
+            if (!pool_failed) log_at(LOG_WARN, "Dynamics: object pool read failed, keeping the previous objects");
+            pool_failed = 1;
+        } else {
+            pool_failed = 0;
+        }
+        if (rc == 1) {
+            l->hit_for = l->version;    // fresh set: nothing consumed yet
+            memset(l->hit, 0, l->count);
+            hits_dirty = 1;
+            rec_objects(rec, step, kind, l);
+        }
+    }
+    return apply_reset(vb, k, objs) || hits_dirty;
+}
 
-    int play_w = bb_play_width(bb);
-    int play_h = bb_play_height(bb);
+// A reset came in: start over and hide the current objects until the
+// generators publish new ones. Returns 1 if it did (the hit masks changed).
+static int apply_reset(newBlackboard *vb, Kinematics *k, WorldObjects *objs) {
+    if (vb->input.reset_epoch == vb->drone.reset_epoch) return 0;
+    vb->drone.reset_epoch = vb->input.reset_epoch;
+    vb->drone.drone_x = 2;
+    vb->drone.drone_y = 2;
+    memset(&vb->drone.stats, 0, sizeof(vb->drone.stats));
+    k->x_i = k->x_i_minus_1 = vb->drone.drone_x;
+    k->y_i = k->y_i_minus_1 = vb->drone.drone_y;
+    for (int kind = 0; kind < OBJ_KINDS; kind++) {
+        memset(objs->list[kind].hit, 1, objs->list[kind].count);
+    }
+    return 1;
+}
 
-    for (int i = 0; i < bb->n_obstacles; i++) {
-        if (bb->obstacle_xs[i] < 1 || bb->obstacle_ys[i] < 1 || bb->obstacle_xs[i] >= play_w || bb->obstacle_ys[i] >= play_h) {
-            continue;
+// sync_sections() for a replay: applies what the recording has for this step
+// and gets the step's recorded outcome ready. Returns 0 once it has no more.
+static int replay_sync(Replay *rp, long step, newBlackboard *vb, Kinematics *k, WorldObjects *objs, int *hits_dirty) {
+    *hits_dirty = 0;
+    while (rp->next == rp->n_steps) {
+        const RecTag *t = rec_next(&rp->rd);
+        if (!t) return 0;
+        if (t->step != step) {
+            log_at(LOG_ERROR, "Dynamics: recording out of step (record for step %lld at step %ld), replay stopped", (long long)t->step, step);
+            if (rp->first_bad < 0) rp->first_bad = step;
+            rp->mismatches++;
+            return 0;
         }
-        dx = bb->obstacle_xs[i] - bb->drone_x;  
-        dy = bb->obstacle_ys[i] - bb->drone_y;
-        dist = sqrt(dx * dx + dy * dy);
-        if (dist < bb->physix.radius && dist > 0) {
-            repulsive = bb->physix.obst_repl_coef * 3 * (1.0 / dist - 1.0 / bb->physix.radius) / (dist * dist + EPSILON);
-            *Fx -= repulsive * (dx / (dist + EPSILON));
-            *Fy -= repulsive * (dy / (dist + EPSILON));
+        const void *p = t + 1;
+        switch (t->type) {
+        case REC_CONFIG:
+            memcpy(&vb->config, p, sizeof(vb->config));
+            break;
+        case REC_WORLD:
+            memcpy(&vb->world, p, sizeof(vb->world));
+            break;
+        case REC_INPUT:
+            memcpy(&vb->input, p, sizeof(vb->input));
+            break;
+        case REC_DRONE:
+            memcpy(&vb->drone, p, sizeof(vb->drone));
+            k->x_i = k->x_i_minus_1 = vb->drone.drone_x;
+            k->y_i = k->y_i_minus_1 = vb->drone.drone_y;
+            break;
+        case REC_OBJECTS: {
+            const RecObjects *o = p;
+            const int32_t *xs = (const int32_t *)(o + 1);
+            if (o->kind < 0 || o->kind >= OBJ_KINDS) break;
+            ObjectList *l = &objs->list[o->kind];
+            if (object_list_reserve(l, o->count) == -1) {
+                perror("Dynamics: object list allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(l->xs, xs, sizeof(int) * o->count);
+            memcpy(l->ys, xs + o->count, sizeof(int) * o->count);
+            l->count = o->count;
+            l->occ_w = l->occ_h = 0;    // hits are looked up in the grid then, same outcome
+            l->version = l->hit_for = o->version;
+            memset(l->hit, 0, l->count);
+            *hits_dirty = 1;
+            break;
+        }
+        case REC_STEPS:
+            rp->steps = p;
+            rp->n_steps = t->len / sizeof(RecStep);
+            rp->next = 0;
+            break;
         }
-    } // Obstacles
-
-    if (bb->drone_x < bb->physix.radius) {
-        repulsive = bb->physix.obst_repl_coef * (1.0 / (bb->drone_x + EPSILON) - 1.0 / bb->physix.radius) / (bb->drone_x * bb->drone_x + EPSILON);
-        *Fx += repulsive;
-    } // Left wall
-    if (play_w - bb->drone_x < bb->physix.radius) {
-        repulsive = bb->physix.obst_repl_coef * (1.0 / (play_w - bb->drone_x + EPSILON) - 1.0 / bb->physix.radius) / ((play_w - bb->drone_x) * (play_w - bb->drone_x) + EPSILON);
-        *Fx -= repulsive;
-    } // Right wall
-    if (bb->drone_y < bb->physix.radius) {
-        repulsive = bb->physix.obst_repl_coef * (1.0 / (bb->drone_y + EPSILON) - 1.0 / bb->physix.radius) / (bb->drone_y * bb->drone_y + EPSILON);
-        *Fy += repulsive;
-    } // Top wall
-    if (play_h - bb->drone_y < bb->physix.radius) {
-        repulsive = bb->physix.obst_repl_coef * (1.0 / (play_h - bb->drone_y + EPSILON) - 1.0 / bb->physix.radius) / ((play_h - bb->drone_y) * (play_h - bb->drone_y) + EPSILON);
-        *Fy -= repulsive;
-    } // Bottom wall
-
-    // Limit the repulsion force to a maximum of 100  // TODO PARAMETER
-    if (*Fx > 100){ *Fx = 100;}
-    if (*Fy > 100){ *Fy = 100;}
-    if (*Fx < -100){ *Fx = -100;}
-    if (*Fy < -100){ *Fy = -100;}
+    }
+    rp->next++;
+    if (apply_reset(vb, k, objs)) *hits_dirty = 1;
+    return 1;
 }
 
-void compute_attractive_force(double *Fx, double *Fy, newBlackboard *bb) {
-    *Fx = 0;
-    *Fy = 0;
-    double dx, dy, dist, attractive;
-
-    int play_w = bb_play_width(bb);
-    int play_h = bb_play_height(bb);
+// Everything the next step starts from, down to the last bit.
+static uint32_t step_check(const newBlackboard *vb, const Kinematics *k) {
+    uint64_t h = rec_hash(REC_HASH_SEED, k, sizeof(*k));
+    h = rec_hash(h, &vb->drone.stats, sizeof(vb->drone.stats));
+    return (uint32_t)(h ^ (h >> 32));
+}
 
-    for (int i = 0; i < bb->n_targets; i++) {
-        if (bb->target_xs[i] < 1 || bb->target_ys[i] < 1 || bb->target_xs[i] >= play_w || bb->target_ys[i] >= play_h) {
-            continue;
-        }
-        dx = bb->target_xs[i] - bb->drone_x;
-        dy = bb->target_ys[i] - bb->drone_y;
-        dist = sqrt(dx * dx + dy * dy);
-
-        if (dist < bb->physix.radius && dist > 0) {
-            attractive = bb->physix.obst_repl_coef * 0.05 * (dist);
-            *Fx += attractive * (dx / (dist + EPSILON));
-            *Fy += attractive * (dy / (dist + EPSILON));
+// Applies the keys queued since the last step, oldest first, and publishes
+// the input they add up to. Nobody else writes the input section.
+static void take_commands(newBlackboard *bb, sem_t *sem, BBInput *in, Recorder *rec, long step) {
+    BBCommand c;
+    int changed = 0;
+    while (bb_command_pop(&bb->commands, &c)) {
+        rec_event(rec, REC_COMMAND, step, &c, sizeof(c));
+        if (bb_command_apply(in, &c)) {
+            logger("Dynamics: quit from the keyboard");
+            bb_quit(bb, sem);
         }
+        changed = 1;
+    }
+    if (changed) {
+        BB_PUBLISH(&bb->input, *in);
+        rec_event(rec, REC_INPUT, step, in, sizeof(*in));
+    }
+}
+
+static void update_field(newBlackboard *vb, WorldObjects *objs, int hits_dirty) {
+    int play_w = bb_play_width(&vb->world);
+    int play_h = bb_play_height(&vb->world);
+    if (force_field_update(&objs->field, objs->list, play_w, play_h, vb->config.physix.radius, hits_dirty) == -1) {
+        perror("Dynamics: spatial grid allocation failed");
+        log_at(LOG_ERROR, "Dynamics: spatial grid allocation failed, exiting");
+        exit(EXIT_FAILURE);
     }
 }
 
+static void physics_step(newBlackboard *vb, Kinematics *k, WorldObjects *objs, StepResult *res, HitQueue *hq) {
+    double Fx = vb->input.command_force_x;
+    double Fy = vb->input.command_force_y;
+    int play_w = bb_play_width(&vb->world);
+    int play_h = bb_play_height(&vb->world);
+
+    // objects and walls only act while running, the time only runs then too
+    physics_force(&objs->field, &vb->config.physix, vb->drone.drone_x, vb->drone.drone_y, play_w, play_h,
+                  vb->input.state != 0, &Fx, &Fy);
+    if (vb->input.state != 0) vb->drone.stats.time_elapsed += DT;
+
+    Physix *ph = &vb->config.physix;
+    double x_i_new = physics_integrate(ph->mass, ph->visc_damp_coef, Fx, k->x_i, k->x_i_minus_1);
+    double y_i_new = physics_integrate(ph->mass, ph->visc_damp_coef, Fy, k->y_i, k->y_i_minus_1);
+    vb->drone.drone_x = x_i_new;
+    vb->drone.drone_y = y_i_new;
+    k->x_i_minus_1 = k->x_i;
+    k->x_i = x_i_new;
+    k->y_i_minus_1 = k->y_i;
+    k->y_i = y_i_new;
+
+    physics_bounds(&vb->drone.drone_x, &k->x_i, &k->x_i_minus_1, play_w);
+    physics_bounds(&vb->drone.drone_y, &k->y_i, &k->y_i_minus_1, play_h);
+
+    if (physics_hits(objs, vb->drone.drone_x, vb->drone.drone_y, &vb->drone.stats, hq)) res->hits_dirty = 1;
+    vb->drone.stats.distance_traveled += physics_moved(k->x_i, k->x_i_minus_1, k->y_i, k->y_i_minus_1);
+}
+
+static void drain_hits(HitQueue *hq) {
+    for (int i = 0; i < hq->n; i++) {
+        HitEvent *e = &hq->ev[i];
+        if (e->kind == OBJ_OBSTACLES) {
+            logger("Drone hit an obstacle at position (%d, %d), t=%.3f", e->x, e->y, e->t);
+        } else {
+            logger("Drone got a target at position (%d, %d), t=%.3f", e->x, e->y, e->t);
+        }
+    }
+    if (hq->dropped) log_at(LOG_WARN, "Dynamics: %ld hit events not logged (queue full)", hq->dropped);
+    hq->n = 0;
+    hq->dropped = 0;
+}
@@ -0,0 +1,350 @@
+#ifndef FORCE_KERNEL_H
+#define FORCE_KERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "blackboard.h"
+#include "spatial_grid.h"
+#include "object_pool.h"
+#include "task_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Obstacle repulsion + target attraction in one pass (Dynamics' hot path).
+//
+// Obstacles and targets share a single spatial grid, so the slots around the
+// drone are one contiguous range per grid row. Every slot carries two weights,
+// 1.0/0.0 for "pushes" (alive obstacle) and "pulls" (alive target), so the
+// kernel has no branches on kind or hit state and runs the same arithmetic on
+// every lane; the radius test is a lane mask.
+//
+// Three implementations, picked once at startup: AVX2 (4 doubles), SSE2 (2x2
+// doubles) and scalar. All of them accumulate slot j into lane j%4 and reduce
+// the lanes in the same order, so they return bit-identical sums (as long as
+// the compiler isn't allowed to contract a*b+c into FMA, which the default
+// x86-64 target doesn't have).
+//
+// Dense worlds (at least par_min slots around the drone) are summed in chunks
+// of FORCE_CHUNK_SLOTS slots instead, one accumulator per chunk, reduced in
+// chunk order. The chunks are fixed by slot index, so the sums don't depend on
+// whether the chunks ran on the caller alone or spread over a task pool.
+#define FORCE_LANES 4
+#define FORCE_CHUNK_SLOTS 2048          // multiple of FORCE_LANES
+#define FORCE_PAR_MIN_SLOTS 16384       // default par_min, BB_FORCE_PAR_MIN overrides it
+#define FORCE_MAX_ROWS 3                // cells are radius wide: a query spans 3 rows at most
+
+typedef struct {
+    double x, y;
+    double radius, inv_radius;
+    double k_rep;       // obst_repl_coef * 3
+    double k_att;       // obst_repl_coef * 0.05
+} ForceParams;
+
+typedef struct {             // a cache line of its own: chunks are summed by different threads
+    alignas(BB_CACHELINE) double rep_x[FORCE_LANES];
+    double rep_y[FORCE_LANES];
+    double att_x[FORCE_LANES], att_y[FORCE_LANES];
+} ForceAcc;
+
+typedef struct {
+    double rep_x, rep_y;
+    double att_x, att_y;
+} ForceSums;
+
+struct ForceField;
+typedef void (*force_block_fn)(const struct ForceField *f, int a, int b, const ForceParams *p, ForceAcc *acc);
+
+typedef struct ForceField {
+    SpatialGrid grid;           // grid idx < n_obstacles: obstacle, else target (idx - n_obstacles)
+    int n_obstacles;
+    double *rep_w, *att_w;      // per slot, padded like grid.xs
+    int *src_x, *src_y;         // scratch: both lists concatenated for grid_build
+    int cap_w, cap_src;
+    unsigned int versions[OBJ_KINDS];
+    force_block_fn block;
+    const char *impl;
+    int par_min;                // chunked sums from this many slots in range
+    TaskPool *pool;             // chunks go to it if set (NULL: the caller sums them)
+    ForceAcc *chunk_acc;        // one per chunk of the grid
+    int cap_chunks;
+} ForceField;
+
+static inline void force_block_scalar(const ForceField *f, int a, int b, const ForceParams *p, ForceAcc *acc) {
+    const double *xs = f->grid.xs, *ys = f->grid.ys;
+    for (int j = a; j < b; j++) {
+        int lane = j & (FORCE_LANES - 1);
+        double dx = xs[j] - p->x;
+        double dy = ys[j] - p->y;
+        double dist = sqrt(dx * dx + dy * dy);
+        int in = dist < p->radius && dist > 0;
+        double de = dist + EPSILON;
+        double ux = dx / de, uy = dy / de;
+        double rep = p->k_rep * (1.0 / dist - p->inv_radius) / (dist * dist + EPSILON);
+        double att = p->k_att * dist;
+        acc->rep_x[lane] -= in ? rep * ux * f->rep_w[j] : 0.0;
+        acc->rep_y[lane] -= in ? rep * uy * f->rep_w[j] : 0.0;
+        acc->att_x[lane] += in ? att * ux * f->att_w[j] : 0.0;
+        acc->att_y[lane] += in ? att * uy * f->att_w[j] : 0.0;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef __SSE2__
+// Lanes 0-1 and 2-3 as two SSE registers. Blocks start at a multiple of 4 so
+// the lane of slot j is still j%4; slots outside [a, b) are masked off.
+static inline void force_block_sse2(const ForceField *f, int a, int b, const ForceParams *p, ForceAcc *acc) {
+    const __m128d px = _mm_set1_pd(p->x), py = _mm_set1_pd(p->y);
+    const __m128d radius = _mm_set1_pd(p->radius), inv_radius = _mm_set1_pd(p->inv_radius);
+    const __m128d k_rep = _mm_set1_pd(p->k_rep), k_att = _mm_set1_pd(p->k_att);
+    const __m128d eps = _mm_set1_pd(EPSILON), one = _mm_set1_pd(1.0), zero = _mm_setzero_pd();
+    const __m128d lo = _mm_set1_pd(a), hi = _mm_set1_pd(b);
+    __m128d rx[2], ry[2], ax[2], ay[2];
+    for (int h = 0; h < 2; h++) {
+        rx[h] = _mm_loadu_pd(acc->rep_x + 2 * h);
+        ry[h] = _mm_loadu_pd(acc->rep_y + 2 * h);
+        ax[h] = _mm_loadu_pd(acc->att_x + 2 * h);
+        ay[h] = _mm_loadu_pd(acc->att_y + 2 * h);
+    }
+    for (int j0 = a & ~(FORCE_LANES - 1); j0 < b; j0 += FORCE_LANES) {
+        for (int h = 0; h < 2; h++) {
+            int j = j0 + 2 * h;
+            __m128d idx = _mm_set_pd(j + 1, j);
+            __m128d in = _mm_and_pd(_mm_cmpge_pd(idx, lo), _mm_cmplt_pd(idx, hi));
+            __m128d dx = _mm_sub_pd(_mm_loadu_pd(f->grid.xs + j), px);
+            __m128d dy = _mm_sub_pd(_mm_loadu_pd(f->grid.ys + j), py);
+            __m128d dist = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+            in = _mm_and_pd(in, _mm_and_pd(_mm_cmplt_pd(dist, radius), _mm_cmpgt_pd(dist, zero)));
+            __m128d de = _mm_add_pd(dist, eps);
+            __m128d ux = _mm_div_pd(dx, de), uy = _mm_div_pd(dy, de);
+            __m128d rep = _mm_div_pd(_mm_mul_pd(k_rep, _mm_sub_pd(_mm_div_pd(one, dist), inv_radius)),
+                                     _mm_add_pd(_mm_mul_pd(dist, dist), eps));
+            __m128d att = _mm_mul_pd(k_att, dist);
+            __m128d wr = _mm_loadu_pd(f->rep_w + j), wa = _mm_loadu_pd(f->att_w + j);
+            rx[h] = _mm_sub_pd(rx[h], _mm_and_pd(in, _mm_mul_pd(_mm_mul_pd(rep, ux), wr)));
+            ry[h] = _mm_sub_pd(ry[h], _mm_and_pd(in, _mm_mul_pd(_mm_mul_pd(rep, uy), wr)));
+            ax[h] = _mm_add_pd(ax[h], _mm_and_pd(in, _mm_mul_pd(_mm_mul_pd(att, ux), wa)));
+            ay[h] = _mm_add_pd(ay[h], _mm_and_pd(in, _mm_mul_pd(_mm_mul_pd(att, uy), wa)));
+        }
+    }
+    for (int h = 0; h < 2; h++) {
+        _mm_storeu_pd(acc->rep_x + 2 * h, rx[h]);
+        _mm_storeu_pd(acc->rep_y + 2 * h, ry[h]);
+        _mm_storeu_pd(acc->att_x + 2 * h, ax[h]);
+        _mm_storeu_pd(acc->att_y + 2 * h, ay[h]);
+    }
+}
+#endif
+
+__attribute__((target("avx2")))
+static void force_block_avx2(const ForceField *f, int a, int b, const ForceParams *p, ForceAcc *acc) {
+    const __m256d px = _mm256_set1_pd(p->x), py = _mm256_set1_pd(p->y);
+    const __m256d radius = _mm256_set1_pd(p->radius), inv_radius = _mm256_set1_pd(p->inv_radius);
+    const __m256d k_rep = _mm256_set1_pd(p->k_rep), k_att = _mm256_set1_pd(p->k_att);
+    const __m256d eps = _mm256_set1_pd(EPSILON), one = _mm256_set1_pd(1.0), zero = _mm256_setzero_pd();
+    const __m256d lo = _mm256_set1_pd(a), hi = _mm256_set1_pd(b);
+    const __m256d lane = _mm256_set_pd(3, 2, 1, 0);
+    __m256d rx = _mm256_loadu_pd(acc->rep_x), ry = _mm256_loadu_pd(acc->rep_y);
+    __m256d ax = _mm256_loadu_pd(acc->att_x), ay = _mm256_loadu_pd(acc->att_y);
+    for (int j = a & ~(FORCE_LANES - 1); j < b; j += FORCE_LANES) {
+        __m256d idx = _mm256_add_pd(_mm256_set1_pd(j), lane);
+        __m256d in = _mm256_and_pd(_mm256_cmp_pd(idx, lo, _CMP_GE_OQ), _mm256_cmp_pd(idx, hi, _CMP_LT_OQ));
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(f->grid.xs + j), px);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(f->grid.ys + j), py);
+        __m256d dist = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+        in = _mm256_and_pd(in, _mm256_and_pd(_mm256_cmp_pd(dist, radius, _CMP_LT_OQ), _mm256_cmp_pd(dist, zero, _CMP_GT_OQ)));
+        __m256d de = _mm256_add_pd(dist, eps);
+        __m256d ux = _mm256_div_pd(dx, de), uy = _mm256_div_pd(dy, de);
+        __m256d rep = _mm256_div_pd(_mm256_mul_pd(k_rep, _mm256_sub_pd(_mm256_div_pd(one, dist), inv_radius)),
+                                    _mm256_add_pd(_mm256_mul_pd(dist, dist), eps));
+        __m256d att = _mm256_mul_pd(k_att, dist);
+        __m256d wr = _mm256_loadu_pd(f->rep_w + j), wa = _mm256_loadu_pd(f->att_w + j);
+        rx = _mm256_sub_pd(rx, _mm256_and_pd(in, _mm256_mul_pd(_mm256_mul_pd(rep, ux), wr)));
+        ry = _mm256_sub_pd(ry, _mm256_and_pd(in, _mm256_mul_pd(_mm256_mul_pd(rep, uy), wr)));
+        ax = _mm256_add_pd(ax, _mm256_and_pd(in, _mm256_mul_pd(_mm256_mul_pd(att, ux), wa)));
+        ay = _mm256_add_pd(ay, _mm256_and_pd(in, _mm256_mul_pd(_mm256_mul_pd(att, uy), wa)));
+    }
+    _mm256_storeu_pd(acc->rep_x, rx);
+    _mm256_storeu_pd(acc->rep_y, ry);
+    _mm256_storeu_pd(acc->att_x, ax);
+    _mm256_storeu_pd(acc->att_y, ay);
+}
+#endif
+
+// BB_FORCE_KERNEL=scalar|sse2|avx2 forces an implementation (for comparing them).
+static inline void force_field_select(ForceField *f) {
+    const char *want = getenv("BB_FORCE_KERNEL");
+    f->block = force_block_scalar;
+    f->impl = "scalar";
+    if (want && strcmp(want, "scalar") == 0) return;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && !(want && strcmp(want, "sse2") == 0)) {
+        f->block = force_block_avx2;
+        f->impl = "avx2";
+        return;
+    }
+#ifdef __SSE2__
+    f->block = force_block_sse2;
+    f->impl = "sse2";
+#endif
+#endif
+}
+
+static inline void force_field_init(ForceField *f) {
+    memset(f, 0, sizeof(*f));
+    grid_init(&f->grid);
+    memset(f->versions, 0xff, sizeof(f->versions));
+    force_field_select(f);
+    const char *par_min = getenv("BB_FORCE_PAR_MIN");
+    f->par_min = par_min ? atoi(par_min) : FORCE_PAR_MIN_SLOTS;
+    if (f->par_min < FORCE_CHUNK_SLOTS) f->par_min = FORCE_CHUNK_SLOTS;
+}
+
+// Object behind grid slot j: index into lists[*kind], -1 for padding.
+static inline int force_field_object(const ForceField *f, int j, int *kind) {
+    int i = f->grid.idx[j];
+    *kind = (i >= f->n_obstacles) ? OBJ_TARGETS : OBJ_OBSTACLES;
+    return (i >= f->n_obstacles) ? i - f->n_obstacles : i;
+}
+
+// Per-slot weights from the hit masks. Cheap next to a rebuild, and only
+// needed when a set is new or Dynamics consumed/reset something.
+static inline void force_field_weights(ForceField *f, const ObjectList lists[OBJ_KINDS]) {
+    int padded = grid_padded(f->grid.count);
+    for (int j = 0; j < padded; j++) {
+        int i = f->grid.idx[j];
+        f->rep_w[j] = 0.0;
+        f->att_w[j] = 0.0;
+        if (i < 0) continue;
+        if (i < f->n_obstacles) {
+            f->rep_w[j] = object_alive(&lists[OBJ_OBSTACLES], i) ? 1.0 : 0.0;
+        } else {
+            f->att_w[j] = object_alive(&lists[OBJ_TARGETS], i - f->n_obstacles) ? 1.0 : 0.0;
+        }
+    }
+}
+
+// Rebuild the grid if a set, the play area or the radius changed, then refresh
+// the weights if the grid moved or the hit masks did. Returns -1 on OOM.
+static inline int force_field_update(ForceField *f, const ObjectList lists[OBJ_KINDS],
+                                     int play_w, int play_h, double radius, int hits_dirty) {
+    const ObjectList *obst = &lists[OBJ_OBSTACLES], *targ = &lists[OBJ_TARGETS];
+    int rebuild = f->versions[OBJ_OBSTACLES] != obst->version || f->versions[OBJ_TARGETS] != targ->version ||
+                  grid_stale(&f->grid, f->grid.version, play_w, play_h, radius);
+    if (rebuild) {
+        int n = obst->count + targ->count;
+        if (n > f->cap_src) {
+            int *sx = realloc(f->src_x, sizeof(int) * n);
+            if (sx) f->src_x = sx;
+            int *sy = realloc(f->src_y, sizeof(int) * n);
+            if (sy) f->src_y = sy;
+            if (!sx || !sy) return -1;
+            f->cap_src = n;
+        }
+        if (obst->count > 0) {
+            memcpy(f->src_x, obst->xs, sizeof(int) * obst->count);
+            memcpy(f->src_y, obst->ys, sizeof(int) * obst->count);
+        }
+        if (targ->count > 0) {
+            memcpy(f->src_x + obst->count, targ->xs, sizeof(int) * targ->count);
+            memcpy(f->src_y + obst->count, targ->ys, sizeof(int) * targ->count);
+        }
+        if (grid_build(&f->grid, f->src_x, f->src_y, n, play_w, play_h, radius, 0) == -1) return -1;
+        f->n_obstacles = obst->count;
+        f->versions[OBJ_OBSTACLES] = obst->version;
+        f->versions[OBJ_TARGETS] = targ->version;
+        if (f->grid.cap_items > f->cap_w) {
+            double *rw = realloc(f->rep_w, sizeof(double) * f->grid.cap_items);
+            if (rw) f->rep_w = rw;
+            double *aw = realloc(f->att_w, sizeof(double) * f->grid.cap_items);
+            if (aw) f->att_w = aw;
+            if (!rw || !aw) return -1;
+            f->cap_w = f->grid.cap_items;
+        }
+        int chunks = f->grid.count / FORCE_CHUNK_SLOTS + 1;
+        if (chunks > f->cap_chunks) {
+            ForceAcc *ca = aligned_alloc(alignof(ForceAcc), sizeof(ForceAcc) * chunks);
+            if (!ca) return -1;
+            free(f->chunk_acc);
+            f->chunk_acc = ca;
+            f->cap_chunks = chunks;
+        }
+    }
+    if (rebuild || hits_dirty) force_field_weights(f, lists);
+    return 0;
+}
+
+// One query in chunks: the slot ranges of its rows (ascending) and the chunks
+// [first, first + n) that cover them.
+typedef struct {
+    const ForceField *f;
+    ForceParams p;
+    int rows;
+    int a[FORCE_MAX_ROWS], b[FORCE_MAX_ROWS];
+    int first;
+} ForceQuery;
+
+static void force_chunk_task(void *arg, int k) {
+    const ForceQuery *q = arg;
+    int c = q->first + k;
+    int lo = c * FORCE_CHUNK_SLOTS, hi = lo + FORCE_CHUNK_SLOTS;
+    ForceAcc *acc = &q->f->chunk_acc[c];
+    memset(acc, 0, sizeof(*acc));
+    for (int r = 0; r < q->rows; r++) {
+        int a = (q->a[r] > lo) ? q->a[r] : lo;
+        int b = (q->b[r] < hi) ? q->b[r] : hi;
+        if (a < b) q->f->block(q->f, a, b, &q->p, acc);
+    }
+}
+
+// Object forces on a drone at (x, y): repulsive sum of the obstacles and
+// attractive sum of the targets within physix.radius (walls/clamping are the
+// caller's business).
+static inline void force_field_eval(const ForceField *f, double x, double y, const Physix *ph, ForceSums *out) {
+    ForceQuery q = { f, { x, y, ph->radius, 1.0 / ph->radius, ph->obst_repl_coef * 3, ph->obst_repl_coef * 0.05 }, 0, {0}, {0}, 0 };
+    ForceAcc acc;
+    memset(&acc, 0, sizeof(acc));
+    if (f->grid.count > 0) {
+        int cx0, cy0, cx1, cy1, slots = 0;
+        grid_query_range(&f->grid, x, y, ph->radius, &cx0, &cy0, &cx1, &cy1);
+        for (int cy = cy0; cy <= cy1 && q.rows < FORCE_MAX_ROWS; cy++) {
+            int a = f->grid.cell_start[cy * f->grid.cols + cx0];
+            int b = f->grid.cell_start[cy * f->grid.cols + cx1 + 1];
+            if (a >= b) continue;
+            q.a[q.rows] = a;
+            q.b[q.rows] = b;
+            q.rows++;
+            slots += b - a;
+        }
+        if (slots < f->par_min) {
+            for (int r = 0; r < q.rows; r++) f->block(f, q.a[r], q.b[r], &q.p, &acc);
+        } else {
+            q.first = q.a[0] / FORCE_CHUNK_SLOTS;
+            int n = (q.b[q.rows - 1] - 1) / FORCE_CHUNK_SLOTS + 1 - q.first;
+            if (f->pool) {
+                task_pool_run(f->pool, n, force_chunk_task, &q);
+            } else {
+                for (int k = 0; k < n; k++) force_chunk_task(&q, k);
+            }
+            for (int k = 0; k < n; k++) {
+                const ForceAcc *c = &f->chunk_acc[q.first + k];
+                for (int l = 0; l < FORCE_LANES; l++) {
+                    acc.rep_x[l] += c->rep_x[l];
+                    acc.rep_y[l] += c->rep_y[l];
+                    acc.att_x[l] += c->att_x[l];
+                    acc.att_y[l] += c->att_y[l];
+                }
+            }
+        }
+    }
+    out->rep_x = (acc.rep_x[0] + acc.rep_x[1]) + (acc.rep_x[2] + acc.rep_x[3]);
+    out->rep_y = (acc.rep_y[0] + acc.rep_y[1]) + (acc.rep_y[2] + acc.rep_y[3]);
+    out->att_x = (acc.att_x[0] + acc.att_x[1]) + (acc.att_x[2] + acc.att_x[3]);
+    out->att_y = (acc.att_y[0] + acc.att_y[1]) + (acc.att_y[2] + acc.att_y[3]);
+}
+
+#endif
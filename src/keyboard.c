@@ -11,13 +11,14 @@
 #include <signal.h>
 #include <time.h>
 #include <stdbool.h>
+#include <poll.h>
+#include <errno.h>
 #include "blackboard.h"
 
 
-void update_forces(int key, int *Fx, int *Fy, newBlackboard *bb);
-void reset_game(newBlackboard *bb);
 WINDOW* draw_button(WINDOW *parent, int y, int x, const char *label, int width, int height);
 
+#ifndef BB_ENGINE
 int main(int argc, char *argv[]) {
     const char *shm_name = getenv("BB_SHM_NAME");
     if (!shm_name) shm_name = SHM_NAME;
@@ -31,17 +32,62 @@ int main(int argc, char *argv[]) {
         perror("mmap failed");
         return 1;
     }
-    const char *sem_name = getenv("BB_SEM_NAME");
-    if (!sem_name) sem_name = SEM_NAME;
-    sem_t *sem = sem_open(sem_name, 0);
-    if (sem == SEM_FAILED) {
-        perror("sem_open failed");
-        return 1;
+    int rc = keyboard_run(bb, NULL);    // commands go through the ring, no semaphore
+    munmap(bb, sizeof(newBlackboard));
+    kill(getppid(), SIGTERM);
+    return rc;
+}
+#endif
+
+// The command a key stands for. Returns 0 for keys that mean nothing, they
+// never reach the ring.
+static int keyboard_command(int ch, BBCommand *c) {
+    static const struct { int key, key2, dx, dy; } moves[] = {
+        { 'w', KEY_UP,     0, -1 },     // Up
+        { 's', KEY_DOWN,   0,  1 },     // Down
+        { 'a', KEY_LEFT,  -1,  0 },     // Left
+        { 'd', KEY_RIGHT,  1,  0 },     // Right
+        { 'q', 0,         -1, -1 },     // Up-Left
+        { 'e', 0,          1, -1 },     // Up-Right
+        { 'z', 0,         -1,  1 },     // Down-Left
+        { 'c', 0,          1,  1 },     // Down-Right
+    };
+    memset(c, 0, sizeof(*c));
+    for (int i = 0; i < (int)(sizeof(moves)/sizeof(moves[0])); i++) {
+        if (ch == moves[i].key || (moves[i].key2 && ch == moves[i].key2)) {
+            c->cmd = CMD_FORCE;
+            c->dx = moves[i].dx;
+            c->dy = moves[i].dy;
+            return 1;
+        }
     }
-    int fd = open_watchdog_pipe(PIPE_KEYBOARD);
-    logger("Keyboard process started. PID: %d", getpid()); 
+    switch (ch) {
+    case 'x': c->cmd = CMD_BRAKE; return 1;     // Brake
+    case 'i': c->cmd = CMD_START; return 1;
+    case 'y': c->cmd = CMD_RESET; return 1;
+    case 'm': c->cmd = CMD_MAP;   return 1;
+    case 27:  c->cmd = CMD_QUIT;  return 1;
+    }
+    return 0;
+}
 
-    int Fx = 0, Fy = 0;
+// One key pressed: queued for Dynamics, which applies it at its next step.
+// Also used by the engine's Window, which reads the keys in its own terminal.
+// Returns 1 for the exit key.
+int keyboard_key(newBlackboard *bb, int ch) {
+    BBCommand c;
+    if (!keyboard_command(ch, &c)) return 0;
+    c.t_ns = monotonic_ns();
+    if (bb_command_push(&bb->commands, &c) == -1) {
+        log_at(LOG_WARN, "Keyboard: command ring full, key dropped (%u so far)", bb->commands.dropped);
+    }
+    return c.cmd == CMD_QUIT;
+}
+
+int keyboard_run(newBlackboard *bb, sem_t *sem) {
+    Heartbeat hb;
+    heartbeat_open(&hb, bb, WD_KEYBOARD);
+    logger("Keyboard process started. PID: %d", getpid()); 
 
     initscr();
     cbreak();
@@ -74,7 +120,9 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     WINDOW *subwindows[13] = {0};
+    // Keys are waited for with poll() below; getch() only drains what's there.
     nodelay(win, 1); nodelay(stdscr, 1);
+    set_escdelay(25);   // a lone ESC (exit) shouldn't keep us a second in getch()
     box(win, 0, 0);
     refresh();
 
@@ -105,52 +153,71 @@ int main(int argc, char *argv[]) {
     wattrset(win, A_NORMAL);
     // some efforts has been made to reduce the memory consumption of subwindows
 
-    time_t now = time(NULL);
-    while (true) {  
-        for (int i = 0; i < (int)(sizeof(subwindows)/sizeof(subwindows[0])); i++){
-            if (subwindows[i]) { touchwin(subwindows[i]); wrefresh(subwindows[i]); }
-        }
-        mvwprintw(win, 4, 3, "Time Elapsed: %.2f", bb->stats.time_elapsed);
-        mvwprintw(win, 6, 3, "Score: %.2f", bb->score);
-        mvwprintw(win, 9, 3, "Command Forces: Fx = %d  , Fy = %d  ", Fx, Fy);
-        touchwin(win);
-        wrefresh(win);
-
-        int ch = getch();
-        sem_wait(sem); 
-        if (ch == 'y') {
-            reset_game(bb);
-        }
-        if (ch == 'i') {
-            bb->state = 1;
+    wrefresh(win);
+
+    // The status lines are redrawn only when their text changes, and the
+    // blackboard is written only for a key that is a command: a Keyboard
+    // nobody types into sleeps in poll() and wakes up for the stats now and then.
+    BBDrone drone = {0};
+    BBConfig cfg = {0};
+    BBInput input = {0};    // the forces as Dynamics applied them
+    unsigned int drone_seen = ~0u, cfg_seen = ~0u, input_seen = ~0u;
+    static const int rows[3] = { 4, 6, 9 };
+    char shown[3][64] = {{0}};
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    int quit = 0;
+    while (!quit) {
+        BB_READ_IF_CHANGED(&bb->drone, drone, drone_seen);
+        BB_READ_IF_CHANGED(&bb->config, cfg, cfg_seen);
+        BB_READ_IF_CHANGED(&bb->input, input, input_seen);
+        char line[3][64];
+        snprintf(line[0], sizeof(line[0]), "Time Elapsed: %.2f", drone.stats.time_elapsed);
+        snprintf(line[1], sizeof(line[1]), "Score: %.2f", cfg.score);
+        snprintf(line[2], sizeof(line[2]), "Command Forces: Fx = %d  , Fy = %d", input.command_force_x, input.command_force_y);
+        int dirty = 0;
+        for (int i = 0; i < 3; i++) {
+            if (strcmp(line[i], shown[i]) == 0) continue;
+            mvwprintw(win, rows[i], 3, "%-*s", want_w - 4, line[i]);   // padded: a shorter text wipes the old one
+            strcpy(shown[i], line[i]);
+            dirty = 1;
         }
-        if (ch == 27) {
-            bb->state = 2;
-            break;
+        if (dirty) wrefresh(win);
+        heartbeat_tick(&hb);
+
+        // Sleep until a key comes in or the stats are due again. A resize
+        // interrupts poll() and shows up as KEY_RESIZE below.
+        int rc = poll(&pfd, 1, RENDER_DELAY / 1000);
+        if (rc == 0) continue;
+        if (rc == -1 && errno != EINTR) {
+            log_at(LOG_ERROR, "Keyboard: poll failed: %s", strerror(errno));
+            usleep(RENDER_DELAY);
         }
-        if (ch == 'm'){
-            if (bb->state == 1) {
-                bb->state = 3;
-            } else if (bb->state == 3) {
-                bb->state = 1;
+        // ncurses may have read more than one key at once: take them all.
+        int ch;
+        while ((ch = getch()) != ERR) {
+            if (ch == KEY_RESIZE) {
+                touchwin(win);
+                wrefresh(win);
+                continue;
+            }
+            if (keyboard_key(bb, ch)) {
+                quit = 1;
+                break;
             }
         }
-        update_forces(ch, &Fx, &Fy, bb);
-        sem_post(sem);
-        if (difftime(time(NULL), now) >= 3){
-            send_heartbeat(fd);
-            now = time(NULL);
-        }
-        // refresh();
     }
 
-    if (fd >= 0) { close(fd); }
+    // Dynamics posts the quit when it takes it: give it a moment to get there
+    // before we go (our exit takes master down with us).
+    for (int k = 0; k < 100 && __atomic_load_n(&bb->commands.tail, __ATOMIC_ACQUIRE) != bb->commands.head; k++) {
+        usleep(1000);
+    }
+    heartbeat_close(&hb);
+    for (int i = 0; i < (int)(sizeof(subwindows)/sizeof(subwindows[0])); i++){
+        if (subwindows[i]) delwin(subwindows[i]);
+    }
     delwin(win);
     endwin();
-    sem_close(sem);
-    munmap(bb, sizeof(newBlackboard));
-    kill(getppid(), SIGTERM);
-
     return 0;
 }
 
@@ -163,42 +230,3 @@ WINDOW* draw_button(WINDOW *parent, int y, int x, const char *label, int width,
     wrefresh(button_win);
     return button_win;
 }
-
-void update_forces(int key, int *Fx, int *Fy, newBlackboard *bb) {
-    switch (key) {
-        case 'w': case KEY_UP:      *Fy -= 1;   break; // Up
-        case 's': case KEY_DOWN:    *Fy += 1;   break; // Down
-        case 'a': case KEY_LEFT:    *Fx -= 1;   break; // Left
-        case 'd': case KEY_RIGHT:   *Fx += 1;   break; // Right
-        case 'q': *Fx -= 1;         *Fy -= 1;   break; // Up-Left
-        case 'e': *Fx += 1;         *Fy -= 1;   break; // Up-Right
-        case 'z': *Fx -= 1;         *Fy += 1;   break; // Down-Left
-        case 'c': *Fx += 1;         *Fy += 1;   break; // Down-Right
-        case 'x': *Fx = 0;          *Fy = 0;    break; // Brake
-    }
-    bb->command_force_x = * Fx;
-    bb->command_force_y = * Fy;
-}
-
-void reset_game(newBlackboard *bb) {
-    // char text [30];
-    // char *format = "Final score %.2f\n";
-    // logger(sprintf(text, "Score recorded %.2f\n",  bb->score));
-    bb->state = 0;
-    bb->score = 0;
-    bb->drone_x = 2;
-    bb->drone_y = 2;
-    bb->command_force_x = 0;
-    bb->command_force_y = 0;
-    bb->stats.time_elapsed = 0;
-    bb->stats.hit_obstacles = 0;
-    bb->stats.hit_targets = 0;
-    bb->stats.distance_traveled = 0;
-    for (int i = 0; i < MAX_OBJECTS; i++) {
-        bb->obstacle_xs[i] = -1; bb->obstacle_ys[i] = -1;
-    }
-    for (int i = 0; i < MAX_OBJECTS; i++) {
-        bb->target_xs[i] = -1; bb->target_ys[i] = -1;
-    }
-}
-
@@ -0,0 +1,201 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdalign.h>
+
+// Asynchronous logging. logger() never formats, locks or touches the file: it
+// stores a binary record (monotonic timestamp, level, the format string's
+// address as format id, the raw arguments) in a ring owned by the calling
+// thread. A writer thread per process merges the rings by timestamp, formats
+// the records and appends them to the log with one write() per batch.
+//
+// Each ring has exactly one producer (its thread) and one consumer (the
+// writer), so head/tail are plain counters with acquire/release ordering. A
+// full ring drops the record and counts it; logging never blocks the caller.
+// Only a thread's very first logger() call takes a mutex (to register its ring).
+// Threads past LOG_MAX_THREADS share one more ring, under a mutex: they still
+// get logged, just not lock-free.
+//
+// Format strings must be literals (or otherwise outlive the record), %s
+// arguments are copied. Supported conversions: d i u x X o c (with h/l/ll/z),
+// f F e E g G, s, p and %%; flags, width and precision digits but not '*'.
+#define LOG_PATH        "./logs/simulation.log"
+#define LOG_RING_LEN    1024        // records per thread, power of two
+#define LOG_MAX_THREADS 8           // own rings; log_rings[LOG_MAX_THREADS] is the shared one
+#define LOG_MAX_ARGS    8
+#define LOG_STR_BYTES   96          // room for the copied %s arguments of one record
+#define LOG_FLUSH_MS    20          // writer's idle poll period
+#define LOG_BATCH_BYTES 65536
+
+enum { LOG_INFO = 0, LOG_WARN = 1, LOG_ERROR = 2 };
+enum { LOG_ARG_INT, LOG_ARG_LONG, LOG_ARG_LLONG, LOG_ARG_SIZE, LOG_ARG_DOUBLE, LOG_ARG_STR, LOG_ARG_PTR };
+
+typedef struct {
+    long long ts;                   // CLOCK_MONOTONIC, ns
+    const char *fmt;
+    unsigned char level, nargs;
+    unsigned char kind[LOG_MAX_ARGS];
+    union {
+        long long i;
+        double d;
+        const void *p;
+        unsigned short s;           // LOG_ARG_STR: offset into str
+    } arg[LOG_MAX_ARGS];
+    char str[LOG_STR_BYTES];
+} LogRecord;
+
+typedef struct {
+    alignas(64) unsigned int head;  // producer
+    alignas(64) unsigned int tail;  // writer
+    unsigned long dropped;          // producer, read by the writer (approximate is fine)
+    LogRecord rec[LOG_RING_LEN];
+} LogRing;
+
+// The logger's state is one per process, defined in logger.c (every binary
+// links it in): one writer thread merging all rings of the process.
+extern LogRing log_rings[LOG_MAX_THREADS + 1];
+extern int log_nrings;
+extern __thread LogRing *log_my_ring;
+extern pthread_mutex_t log_reg_mutex;
+extern pthread_mutex_t log_shared_mutex;   // producers of the shared ring
+extern pthread_once_t log_once;
+
+void log_start(void);       // starts the writer, once per process (log_once)
+void log_shutdown(void);    // stops the writer after it flushed everything
+
+// Next conversion in fmt after p: returns a pointer to its '%' (NULL if none
+// left), sets *end past the conversion character and *kind to the argument type
+// (-1 for "%%", which takes none).
+static inline const char *log_next_spec(const char *p, const char **end, int *kind) {
+    for (; *p; p++) {
+        if (*p != '%') continue;
+        const char *q = p + 1;
+        if (*q == '%') {
+            *end = q + 1;
+            *kind = -1;
+            return p;
+        }
+        while (*q && strchr("-+ #0123456789.", *q)) q++;
+        int len = 0;            // 0 none, 1 l, 2 ll, 3 z
+        while (*q && strchr("hlzjt", *q)) {
+            if (*q == 'l') len = len ? 2 : 1;
+            if (*q == 'z' || *q == 'j' || *q == 't') len = 3;
+            q++;
+        }
+        if (!*q) break;
+        switch (*q) {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                *kind = LOG_ARG_DOUBLE; break;
+            case 's': *kind = LOG_ARG_STR; break;
+            case 'p': *kind = LOG_ARG_PTR; break;
+            default:
+                *kind = (len == 1) ? LOG_ARG_LONG : (len == 2) ? LOG_ARG_LLONG : (len == 3) ? LOG_ARG_SIZE : LOG_ARG_INT;
+                break;
+        }
+        *end = q + 1;
+        return p;
+    }
+    *end = p;
+    return NULL;
+}
+
+static inline LogRing *log_ring_get(void) {
+    if (log_my_ring) return log_my_ring;
+    pthread_once(&log_once, log_start);
+    pthread_mutex_lock(&log_reg_mutex);
+    if (log_nrings < LOG_MAX_THREADS) {
+        log_my_ring = &log_rings[log_nrings];
+        __atomic_store_n(&log_nrings, log_nrings + 1, __ATOMIC_RELEASE);
+    } else {
+        log_my_ring = &log_rings[LOG_MAX_THREADS];
+    }
+    pthread_mutex_unlock(&log_reg_mutex);
+    return log_my_ring;
+}
+
+static inline void log_vrecord_ring(LogRing *ring, int level, const char *format, va_list ap);
+
+static inline void log_vrecord(int level, const char *format, va_list ap) {
+    LogRing *ring = log_ring_get();
+    if (ring != &log_rings[LOG_MAX_THREADS]) {
+        log_vrecord_ring(ring, level, format, ap);
+        return;
+    }
+    pthread_mutex_lock(&log_shared_mutex);
+    log_vrecord_ring(ring, level, format, ap);
+    pthread_mutex_unlock(&log_shared_mutex);
+}
+
+static inline void log_vrecord_ring(LogRing *ring, int level, const char *format, va_list ap) {
+    unsigned int head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_LEN) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    LogRecord *r = &ring->rec[head % LOG_RING_LEN];
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);    // vDSO, no syscall
+    r->ts = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    r->fmt = format;
+    r->level = (unsigned char)level;
+    r->nargs = 0;
+    size_t str_used = 0;
+    const char *p = format, *end;
+    int kind;
+    while (r->nargs < LOG_MAX_ARGS && log_next_spec(p, &end, &kind)) {
+        p = end;
+        if (kind == -1) continue;
+        int a = r->nargs++;
+        r->kind[a] = (unsigned char)kind;
+        switch (kind) {
+            case LOG_ARG_INT:    r->arg[a].i = va_arg(ap, int); break;
+            case LOG_ARG_LONG:   r->arg[a].i = va_arg(ap, long); break;
+            case LOG_ARG_LLONG:  r->arg[a].i = va_arg(ap, long long); break;
+            case LOG_ARG_SIZE:   r->arg[a].i = (long long)va_arg(ap, size_t); break;
+            case LOG_ARG_DOUBLE: r->arg[a].d = va_arg(ap, double); break;
+            case LOG_ARG_PTR:    r->arg[a].p = va_arg(ap, void *); break;
+            case LOG_ARG_STR: {
+                const char *s = va_arg(ap, const char *);
+                if (!s) s = "(null)";
+                size_t room = sizeof(r->str) - str_used;
+                size_t len = strnlen(s, room ? room - 1 : 0);
+                r->arg[a].s = (unsigned short)str_used;
+                if (room) {
+                    memcpy(r->str + str_used, s, len);
+                    r->str[str_used + len] = '\0';
+                    str_used += len + 1;
+                } else {
+                    r->arg[a].s = (unsigned short)(sizeof(r->str) - 1);   // points at the last '\0'
+                }
+                break;
+            }
+        }
+    }
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Failures: log_at(LOG_WARN, ...) when we carry on, LOG_ERROR when something
+// stops or is lost; the line gets a "WARN: " / "ERROR: " prefix to grep for.
+static inline void log_at(int level, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    log_vrecord(level, format, ap);
+    va_end(ap);
+}
+
+static inline void logger(const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    log_vrecord(LOG_INFO, format, ap);
+    va_end(ap);
+}
+
+#endif
@@ -1,30 +1,163 @@
-#include "logger.h"
-#include <stdarg.h>
-#include <time.h>
-
-void log_message(const char *format, ...) {
-    FILE *log_file = fopen("simple_log.txt", "a");
-    if (!log_file) {
-        fprintf(stderr, "Error: Could not open log file.\n");
-        return;
+#include <signal.h>
+#include "log_ring.h"
+
+// The writer side of log_ring.h and the logger's per-process state. Every
+// binary links this file once, so however many translation units log, a
+// process has one set of rings and one writer thread.
+
+LogRing log_rings[LOG_MAX_THREADS + 1];
+int log_nrings;
+__thread LogRing *log_my_ring;
+pthread_mutex_t log_reg_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t log_shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_once_t log_once = PTHREAD_ONCE_INIT;
+
+static pthread_t log_writer;
+static int log_running, log_stop;
+static volatile sig_atomic_t log_term;     // SIGTERM came in: flush, then die of it
+static pid_t log_owner;
+static long long log_real_minus_mono;  // ns, to turn record timestamps into wall-clock time
+
+// Writer side: format one record into out, returns the length.
+static size_t log_format(const LogRecord *r, char *out, size_t cap) {
+    static time_t last_sec = -1;
+    static char stamp[32];
+    time_t sec = (time_t)((r->ts + log_real_minus_mono) / 1000000000LL);
+    if (sec != last_sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        strftime(stamp, sizeof(stamp), "[%Y-%m-%d %H:%M:%S] ", &tm);
+        last_sec = sec;
     }
+    size_t n = 0;
+    n += snprintf(out + n, cap - n, "%s%s", stamp, r->level == LOG_ERROR ? "ERROR: " : r->level == LOG_WARN ? "WARN: " : "");
 
-    // Get current time
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char time_str[20];
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", t);
+    const char *p = r->fmt, *end;
+    int kind, a = 0;
+    char spec[32];
+    while (n < cap) {
+        const char *s = log_next_spec(p, &end, &kind);
+        if (!s) {
+            n += snprintf(out + n, cap - n, "%s", p);
+            break;
+        }
+        n += snprintf(out + n, cap - n, "%.*s", (int)(s - p), p);
+        if (n >= cap) break;
+        p = end;
+        if (kind == -1) {
+            n += snprintf(out + n, cap - n, "%%");
+            continue;
+        }
+        if (a >= r->nargs) break;
+        size_t sl = (size_t)(end - s) < sizeof(spec) - 1 ? (size_t)(end - s) : sizeof(spec) - 1;
+        memcpy(spec, s, sl);
+        spec[sl] = '\0';
+        switch (r->kind[a]) {
+            case LOG_ARG_INT:    n += snprintf(out + n, cap - n, spec, (int)r->arg[a].i); break;
+            case LOG_ARG_LONG:   n += snprintf(out + n, cap - n, spec, (long)r->arg[a].i); break;
+            case LOG_ARG_LLONG:  n += snprintf(out + n, cap - n, spec, (long long)r->arg[a].i); break;
+            case LOG_ARG_SIZE:   n += snprintf(out + n, cap - n, spec, (size_t)r->arg[a].i); break;
+            case LOG_ARG_DOUBLE: n += snprintf(out + n, cap - n, spec, r->arg[a].d); break;
+            case LOG_ARG_STR:    n += snprintf(out + n, cap - n, spec, r->str + r->arg[a].s); break;
+            case LOG_ARG_PTR:    n += snprintf(out + n, cap - n, spec, r->arg[a].p); break;
+        }
+        a++;
+    }
+    if (n > cap - 1) n = cap - 1;
+    // Messages used to carry their own trailing newline sometimes; keep one.
+    while (n > 0 && out[n - 1] == '\n') n--;
+    out[n++] = '\n';
+    return n;
+}
 
-    // Print timestamp
-    fprintf(log_file, "[%s] ", time_str);
+// Move everything queued so far to the file, oldest record first across rings.
+static void log_drain(int fd) {
+    static char batch[LOG_BATCH_BYTES];
+    static unsigned long reported[LOG_MAX_THREADS + 1];
+    size_t used = 0;
+    int nrings = __atomic_load_n(&log_nrings, __ATOMIC_ACQUIRE);
+    for (;;) {
+        LogRing *best = NULL;
+        for (int i = 0; i <= LOG_MAX_THREADS; i++) {
+            if (i >= nrings && i < LOG_MAX_THREADS) continue;     // own rings not handed out yet; the shared one is last
+            LogRing *r = &log_rings[i];
+            if (r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) continue;
+            if (!best || r->rec[r->tail % LOG_RING_LEN].ts < best->rec[best->tail % LOG_RING_LEN].ts) best = r;
+        }
+        if (!best) break;
+        if (used + 1024 > sizeof(batch)) {
+            if (fd >= 0 && write(fd, batch, used) < 0) perror("log write failed");
+            used = 0;
+        }
+        used += log_format(&best->rec[best->tail % LOG_RING_LEN], batch + used, 1024);
+        __atomic_store_n(&best->tail, best->tail + 1, __ATOMIC_RELEASE);
+    }
+    for (int i = 0; i <= LOG_MAX_THREADS; i++) {
+        unsigned long d = __atomic_load_n(&log_rings[i].dropped, __ATOMIC_RELAXED);
+        if (d != reported[i] && used + 128 <= sizeof(batch)) {
+            used += snprintf(batch + used, 128, "[log] %lu records dropped (ring full)\n", d - reported[i]);
+            reported[i] = d;
+        }
+    }
+    if (used > 0 && fd >= 0 && write(fd, batch, used) < 0) perror("log write failed");
+}
 
-    // Print the message
-    va_list args;
-    va_start(args, format);
-    vfprintf(log_file, format, args);
-    va_end(args);
+static void *log_writer_main(void *arg) {
+    (void)arg;
+    int fd = open(LOG_PATH, O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (fd < 0) perror("Unable to open log file");
+    struct timespec idle = { 0, LOG_FLUSH_MS * 1000000L };
+    while (!__atomic_load_n(&log_stop, __ATOMIC_ACQUIRE) && !log_term) {
+        log_drain(fd);
+        nanosleep(&idle, NULL);
+    }
+    log_drain(fd);
+    if (fd >= 0) close(fd);
+    if (log_term) {
+        // Everything up to the signal is on disk: now end the way SIGTERM
+        // would have, so whoever waits for us still sees it.
+        signal(SIGTERM, SIG_DFL);
+        raise(SIGTERM);
+    }
+    return NULL;
+}
 
-    fprintf(log_file, "\n");
+// Master stops its children with SIGTERM, which would lose whatever is still
+// queued (often the reason for the shutdown). Only async-signal-safe here:
+// the writer sees the flag within LOG_FLUSH_MS and does the rest.
+static void log_on_sigterm(int sig) {
+    (void)sig;
+    log_term = 1;
+}
 
-    fclose(log_file);
+// Stop the writer after it flushed everything (runs at exit, or explicitly).
+void log_shutdown(void) {
+    if (!log_running || getpid() != log_owner) return;  // a forked child that never exec'd
+    __atomic_store_n(&log_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(log_writer, NULL);
+    log_running = 0;
+}
+
+void log_start(void) {
+    struct timespec rt, mono;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    log_real_minus_mono = ((long long)rt.tv_sec - mono.tv_sec) * 1000000000LL + (rt.tv_nsec - mono.tv_nsec);
+    log_owner = getpid();
+    if (pthread_create(&log_writer, NULL, log_writer_main, NULL) != 0) {
+        perror("log writer thread");
+        return;
+    }
+    log_running = 1;
+    atexit(log_shutdown);
+    // Only if nobody handles SIGTERM already (master does, and flushes on its own way out).
+    struct sigaction old;
+    if (sigaction(SIGTERM, NULL, &old) == 0 && old.sa_handler == SIG_DFL) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = log_on_sigterm;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGTERM, &sa, NULL);
+    }
 }
@@ -1,9 +0,0 @@
-#ifndef LOGGER_H
-#define LOGGER_H
-
-#include <stdio.h>
-#include <stdlib.h>
-
-void log_message(const char *format, ...);
-
-#endif
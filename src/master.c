@@ -21,6 +21,10 @@
 #include <sys/wait.h>
 #include <stdbool.h>
 #include "blackboard.h"
+#include "object_pool.h"
+#include "physics.h"
+#include "net_proto.h"
+#include "net_udp.h"
 #include <sys/stat.h>
 #include <cjson/cJSON.h>
 
@@ -31,17 +35,20 @@
 #include <sys/socket.h>
 #include <pthread.h>
 #include <math.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 
 void summon(char *args[]);
+#ifndef BB_ENGINE
 static int command_exists(const char *cmd);
-double calculate_score(newBlackboard *bb);
+#endif
+double calculate_score(const Stats *stats);
 void initialize_logger();
 void cleanup_logger();
-void read_json(newBlackboard *bb, bool first_time);
-void create_named_pipe(const char *pipe_name);
+void read_json(BBConfig *cfg, bool first_time);
 void handle_sigchld(int sig);
-void cleanup_pipes(void);
 void cleanup_ipc(void);
 
 /* Handle Ctrl+C / terminal close so we can shutdown both peers cleanly. */
@@ -58,14 +65,17 @@ typedef struct {
 } net_args_t;
 
 static void *network_thread(void *arg);
-static int send_line(int sock, const char *line);
-static int recv_line(int sock, char *buf, size_t buflen);
-static void local_to_virtual(const newBlackboard *bb, int x, int y, double *vx, double *vy);
-static void virtual_to_local(const newBlackboard *bb, double vx, double vy, int *x, int *y);
+static int send_line(NetConn *c, const char *line);
+static int recv_line(NetConn *c, char *buf, size_t buflen);
+static void local_to_virtual(const BBWorld *world, int x, int y, double *vx, double *vy);
+static void virtual_to_local(const BBWorld *world, double vx, double vy, int *x, int *y);
+static void remote_sample(newBlackboard *bb, const BBWorld *world, double vx, double vy);
+static int binary_session(net_args_t *na, NetConn *c);
+static int server_session(net_args_t *na, int lsock);
 
 static volatile sig_atomic_t terminated = 0;
 
-/* Small flag: once handshake finishes, client has the right size in bb->max_* */
+/* Small flag: once handshake finishes, client has the server's size in bb->net (Window copies it into bb->world) */
 static volatile sig_atomic_t net_size_ready = 0;
 
 /* If the socket disconnects (server or client), exit the whole simulation locally. */
@@ -74,17 +84,163 @@ static volatile sig_atomic_t net_lost = 0;
 /* Local quit request (Ctrl+C / terminal close). */
 static volatile sig_atomic_t quit_requested = 0;
 
-int main() {
+#ifdef BB_ENGINE
+// ---- Single-binary engine ----
+// Built with -DBB_ENGINE, master runs the components as threads of its own
+// (their *_run() entry points) instead of forking them into terminals. Window
+// runs on our terminal and takes Keyboard's keys too: two ncurses screens
+// can't share one terminal. A component returning plays the part of a child
+// exiting: it sends us SIGCHLD and we shut everything down.
+typedef struct {
+    const char *name;
+    int (*run)(newBlackboard *bb, sem_t *sem);     // NULL: handled by another thread
+    pthread_t th;
+    int started;
+    int status;             // what run() returned
+    int done;
+} EngineComponent;
+
+static EngineComponent engine_components[] = {
+    { "Window", window_run }, { "Dynamics", dynamics_run }, { "Keyboard", NULL },
+    { "Watchdog", watchdog_run }, { "Obstacle", obstacle_run }, { "Target", target_run },
+};
+static newBlackboard *engine_bb;
+static sem_t *engine_sem;
+static pthread_t engine_master;
+static EngineComponent *engine_ended;    // the first one to return
+
+static void *engine_thread(void *arg) {
+    EngineComponent *c = arg;
+    c->status = c->run(engine_bb, engine_sem);
+    __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+    EngineComponent *none = NULL;
+    __atomic_compare_exchange_n(&engine_ended, &none, c, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    pthread_kill(engine_master, SIGCHLD);
+    return NULL;
+}
+
+static EngineComponent *engine_find(const char *name) {
+    for (size_t i = 0; i < sizeof(engine_components) / sizeof(engine_components[0]); i++) {
+        if (strcmp(engine_components[i].name, name) == 0) return &engine_components[i];
+    }
+    return NULL;
+}
+
+// Starts the named components. Returns -1 if one of them couldn't be started.
+static int engine_start(newBlackboard *bb, sem_t *sem, const char *names[], int n) {
+    engine_bb = bb;
+    engine_sem = sem;
+    engine_master = pthread_self();
+    for (int i = 0; i < n; i++) {
+        EngineComponent *c = engine_find(names[i]);
+        if (!c) continue;
+        if (!c->run) {      // Keyboard: Window reads the keys, nobody ticks its heartbeat slot
+            __atomic_store_n(&bb->heartbeat[WD_KEYBOARD].pid, -1, __ATOMIC_RELEASE);
+            continue;
+        }
+        if (pthread_create(&c->th, NULL, engine_thread, c) != 0) {
+            perror("pthread_create(component)");
+            return -1;
+        }
+        c->started = 1;
+        logger("Engine: %s thread started", c->name);
+        if (c->run == window_run) {
+            // What the sleep(1) before the first fork is for: the generators
+            // should place their first objects on the real terminal size.
+            BBWorld world;
+            for (int k = 0; k < 1000; k++) {
+                BB_READ(&bb->world, world);
+                if (world.win_ready) break;
+                usleep(1000);
+            }
+        }
+    }
+    return 0;
+}
+
+// Posts a quit and gives Window a moment to restore the terminal. Returns the
+// component that ended first (NULL if we stopped on our own).
+static const EngineComponent *engine_stop(newBlackboard *bb, sem_t *sem) {
+    EngineComponent *ended = __atomic_load_n(&engine_ended, __ATOMIC_ACQUIRE);
+    bb_quit(bb, sem);
+    EngineComponent *w = engine_find("Window");
+    // It leaves its loop on the quit within a frame; a hung one (the
+    // watchdog's doing) doesn't get to keep us here.
+    for (int k = 0; w->started && k < 1000 && !__atomic_load_n(&w->done, __ATOMIC_ACQUIRE); k++) {
+        usleep(1000);
+    }
+    return ended;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    // Headless batch mode: no Window/Keyboard/Watchdog and no prompts,
+    // Dynamics plays SCRIPT (see dynamics.c) as fast as it can and we print
+    // the outcome once it's done. --replay FILE is the same with a recording
+    // (see recorder.h) instead of a script; --record FILE records any run.
+    const char *script = NULL, *replay = NULL, *record = NULL;
+    int with_objects = 0, realtime = 0, sized = 0, size_w = 80, size_h = 24;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            script = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record = argv[++i];
+        } else if (strcmp(argv[i], "--objects") == 0) {
+            with_objects = 1;
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime = 1;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &size_w, &size_h) == 2) {
+            sized = 1;
+            i++;
+        } else {
+            fprintf(stderr, "usage: %s [--record FILE] [--headless SCRIPT [--objects] [--realtime] [--size WxH]]\n"
+                            "       %s --replay FILE [--realtime]\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (script && access(script, R_OK) != 0) {
+        perror("headless script");
+        return 1;
+    }
+    if (replay && access(replay, R_OK) != 0) {
+        perror("replay");
+        return 1;
+    }
+    if (script && replay) {
+        fprintf(stderr, "--headless and --replay don't go together\n");
+        return 1;
+    }
+    if (replay && (with_objects || record || sized)) {
+        fprintf(stderr, "a replay has its world, objects and input from the recording, --objects/--record/--size don't apply\n");
+        return 1;
+    }
+    int headless = script || replay;
+    if (!headless && (with_objects || realtime || sized)) {
+        fprintf(stderr, "--objects/--realtime/--size only apply to --headless runs\n");
+        return 1;
+    }
+    if (record) setenv("BB_RECORD", record, 1);
+
     signal(SIGCHLD, handle_sigchld);
     signal(SIGINT,  handle_sigint);
     signal(SIGTERM, handle_sigint);
 
-    create_named_pipe(PIPE_BLACKBOARD);
-    create_named_pipe(PIPE_DYNAMICS);
-    create_named_pipe(PIPE_KEYBOARD);
-    create_named_pipe(PIPE_WINDOW);
-    create_named_pipe(PIPE_OBSTACLE);
-    create_named_pipe(PIPE_TARGET);
+#ifdef BB_ENGINE
+    // One process: the blackboard is private memory the component threads share.
+    newBlackboard *bb = mmap(NULL, sizeof(newBlackboard), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bb == MAP_FAILED) {
+        perror("mmap failed");
+        return 1;
+    }
+    static sem_t quit_sem;      // unnamed: only our threads use it
+    sem_t *sem = &quit_sem;
+    if (sem_init(sem, 0, 1) == -1) {
+        perror("sem_init failed");
+        return 1;
+    }
+#else
     int shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
     if (shm_fd == -1) {
         perror("shm_open failed");
@@ -107,36 +263,50 @@ int main() {
         perror("sem_open failed");
         return 1;
     }
-    int fd = open_watchdog_pipe(PIPE_BLACKBOARD);
-    read_json(bb, true);
+#endif
+    Heartbeat hb;
+    heartbeat_open(&hb, bb, WD_BLACKBOARD);
 
     initialize_logger();
     logger("Blackboard server started. PID: %d", getpid());
 
-    // INITIALIZE THE BLACKBOARD
-    bb->state = 0;  // 0 for paused or waiting, 1 for running, 2 for quit
-    bb->score = 0.0;
-    bb->drone_x = 2; bb->drone_y = 2;
-    bb->remote_drone_x = -1;
-    bb->remote_drone_y = -1;
-    for (int i = 0; i < MAX_OBJECTS; i++) {
-        bb->obstacle_xs[i] = -1; bb->obstacle_ys[i] = -1;
-        bb->target_xs[i] = -1; bb->target_ys[i] = -1;
-    }
-    bb->command_force_x = 0; bb->command_force_y = 0;
-    bb->max_width   = 20; bb->max_height  = 20; // Window process overwrites these (server) / handshake overwrites (client)
-    bb->win_ready = 0;
-    bb->net_lock_size = 0;
-    bb->win_ready = 0;
-    bb->net_lock_size = 0;
-    bb->stats.hit_obstacles = 0; bb->stats.hit_targets = 0;
-    bb->stats.time_elapsed = 0.0; bb->stats.distance_traveled = 0.0;
-
-    bb->score = calculate_score(bb);
-    read_json(bb, true);
-
-    int mode;
-    while (1) {
+    // INITIALIZE THE BLACKBOARD (nobody else is attached yet, plain writes are fine)
+    BBConfig cfg;   // master owns bb->config: edit this copy, then BB_PUBLISH it
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.net_interp_delay_ms = NET_INTERP_DELAY_MS;
+    read_json(&cfg, true);
+    // One seed for the generators' random streams (BB_SEED to pick it); a
+    // recording keeps it, so a session can be generated again.
+    const char *env_seed = getenv("BB_SEED");
+    cfg.seed = env_seed ? strtoull(env_seed, NULL, 0) : ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid();
+    logger("Seed: %llu", (unsigned long long)cfg.seed);
+    bb->input.state = 0;  // 0 for paused or waiting, 1 for running, 3 map view
+    bb->drone.drone_x = 2; bb->drone.drone_y = 2;
+    bb->net.remote_drone_x = -1;
+    bb->net.remote_drone_y = -1;
+    bb->input.command_force_x = 0; bb->input.command_force_y = 0;
+    bb->world.max_width   = 20; bb->world.max_height  = 20; // Window process overwrites these (server) / Window copies the handshake size (client)
+    bb->world.win_ready = 0;
+    bb->net.net_lock_size = 0;
+    bb->drone.stats.hit_obstacles = 0; bb->drone.stats.hit_targets = 0;
+    bb->drone.stats.time_elapsed = 0.0; bb->drone.stats.distance_traveled = 0.0;
+
+    cfg.score = calculate_score(&bb->drone.stats);
+    BB_PUBLISH(&bb->config, cfg);
+
+    // Obstacle/target positions live in a separate pool sized from the config;
+    // the counts in bb->objects[] start at 0 so nothing is read from it yet.
+    ObjectPool pool;
+    int want = cfg.max_objects > 0 ? cfg.max_objects : DEFAULT_MAX_OBJECTS;
+    if (cfg.n_obstacles > want) want = cfg.n_obstacles;
+    if (cfg.n_targets > want) want = cfg.n_targets;
+    if (pool_create(&pool, bb, pool_chunks_for(want)) == -1) {
+        perror("object pool creation failed");
+        return 1;
+    }
+
+    int mode = 1;
+    while (!headless) {
         printf("\n=== === === ===\n\nWELCOME TO DRONE SIMULATION.\n\nChoose mode of operation ...\n"
             "(1): Local object generation and simulation\n"
             "(2): Networked simulation (Assignment 3 - socket client/server)\n"
@@ -151,12 +321,28 @@ int main() {
         }
         fprintf(stderr, "Invalid choice. Please enter 1 or 2.\n");
     }
-    printf("\n=== === === ===\n\n");
+    if (!headless) printf("\n=== === === ===\n\n");
 
     // In networked mode (Assignment 3), obstacle/target generators and watchdog are disabled per spec.
     const char *processNames[NUMBER_OF_PROCESSES] = {0};
     int processCount = 0;
-    if (mode == 1) {
+    if (headless) {
+        // No terminal: we publish the world size Window would have, and
+        // Dynamics gets the script (or the recording) instead of Keyboard's input.
+        const char *temp[] = {"Dynamics", "Obstacle", "Target"};
+        memcpy((void*)processNames, temp, sizeof(temp));
+        processCount = with_objects ? 3 : 1;
+        BB_WRITE_BEGIN(&bb->world);
+        bb->world.max_width = size_w;
+        bb->world.max_height = size_h;
+        bb->world.win_ready = 1;
+        BB_WRITE_END(&bb->world);
+        if (script) setenv("BB_SCRIPT", script, 1);
+        if (replay) setenv("BB_REPLAY", replay, 1);
+        if (!realtime) setenv("BB_FAST", "1", 1);
+        if (with_objects) setenv("BB_WAIT_OBJECTS", "1", 1);
+        heartbeat_close(&hb);   // no watchdog either
+    } else if (mode == 1) {
         const char *temp[] = {"Window", "Dynamics", "Keyboard", "Watchdog", "Obstacle", "Target"};
         memcpy((void*)processNames, temp, sizeof(temp));
         processCount = NUMBER_OF_PROCESSES;
@@ -201,13 +387,19 @@ int main() {
             }
         }
 
-        fd = -1; // watchdog disabled in network mode
+        heartbeat_close(&hb); // watchdog disabled in network mode
     }
 
+#ifdef BB_ENGINE
+    if (mode == 2 && !net_args.is_server) setenv("BB_LOCK_SIZE", "1", 1);
+    if (engine_start(bb, sem, processNames, processCount) == -1) {
+        return EXIT_FAILURE;
+    }
+#else
     pid_t allPIDs[NUMBER_OF_PROCESSES] = {0};
 
     for (int i = 0; i < processCount; i++) {
-        if (i == 0){
+        if (i == 0 && !headless){
             sleep(1);
         }
         pid_t pid = fork();
@@ -270,6 +462,7 @@ int main() {
             printf("Launched %s, PID: %d\n", processNames[i], pid);  // TODO DELETE LATER
         }
     }
+#endif
 
     while (1) {
         if (terminated) {
@@ -279,22 +472,40 @@ int main() {
         /* If the remote peer disconnects (or we requested quit), shutdown locally too.
            In server mode, the network thread will also send 'q' so the client exits cleanly. */
         if (mode == 2 && (net_lost || quit_requested)) {
-            sem_wait(sem);
-            bb->state = 2;
-            sem_post(sem);
+            bb_quit(bb, sem);
             terminated = 1;
             break;
         }
-
-        sem_wait(sem);
-
-        bb->score = calculate_score(bb);
-        read_json(bb, true);
-        sem_post(sem);
-        if (fd >= 0) send_heartbeat(fd);
-        sleep(BLACKBOARD_CHECK_DELAY);  // freq of 0.2 Hz
+#ifdef BB_ENGINE
+        // No children to take the Ctrl+C with them: it's ours to act on.
+        if (quit_requested) break;
+#endif
+
+        // File I/O happens on our private copy; the seqlock write is just the copy.
+        BBDrone drone;
+        BB_READ(&bb->drone, drone);
+        cfg.score = calculate_score(&drone.stats);
+        read_json(&cfg, true);
+        int need = (cfg.n_obstacles > cfg.n_targets) ? cfg.n_obstacles : cfg.n_targets;
+        if (need > pool_capacity(&pool)) {
+            // Grow before publishing the new counts, so the generators find room for them.
+            if (pool_grow(&pool, bb, pool_chunks_for(need)) == -1) {
+                log_at(LOG_WARN, "Object pool growth to %d objects failed, keeping %d", need, pool_capacity(&pool));
+            } else {
+                logger("Object pool grown to %d objects per kind", pool_capacity(&pool));
+            }
+        }
+        BB_PUBLISH(&bb->config, cfg);
+        heartbeat_sleep(&hb, BLACKBOARD_CHECK_DELAY * 1000000000LL);  // freq of 0.2 Hz
     }
 
+#ifdef BB_ENGINE
+    const EngineComponent *ended = engine_stop(bb, sem);
+    printf("%s ended. Stopping the simulation...\n", ended ? ended->name : "Master");
+    // Headless: a run is good if Dynamics finished its script (or replayed
+    // the recording exactly).
+    int run_ok = ended && ended->run == dynamics_run && ended->status == 0;
+#else
     // Wait for any process to terminate
     int status;
     pid_t terminatedPid = wait(&status);
@@ -304,76 +515,60 @@ int main() {
     }
 
     printf("Process %d terminated. Terminating all other processes...\n", terminatedPid);
+    int run_ok = terminatedPid == allPIDs[0] && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+
+    int exit_code = EXIT_SUCCESS;
+    if (headless) {
+        BBDrone drone;
+        BB_READ(&bb->drone, drone);
+        printf("RESULT time=%.3f score=%.2f hits_obstacles=%d hits_targets=%d distance=%.3f x=%d y=%d\n",
+               drone.stats.time_elapsed, calculate_score(&drone.stats), drone.stats.hit_obstacles,
+               drone.stats.hit_targets, drone.stats.distance_traveled, drone.drone_x, drone.drone_y);
+        if (!run_ok) exit_code = EXIT_FAILURE;
+    }
 
+#ifdef BB_ENGINE
+    // The other threads may still be using the blackboard and the pool: leave
+    // both mapped, returning from main ends them all.
+    heartbeat_close(&hb);
+    cleanup_logger();
+#else
     // Terminate remaining processes
     for (int i = 0; i < processCount; i++) {
         if (allPIDs[i] != 0 && allPIDs[i] != terminatedPid) {
             kill(allPIDs[i], SIGTERM);
         }
     }
-    if (fd >= 0) { close(fd); }  // close pipe
+    heartbeat_close(&hb);  // not watched anymore
     cleanup_logger();
     sem_close(sem);
 
+    pool_close(&pool);
     munmap(bb, sizeof(newBlackboard));
 
-      // Remove master-created named pipes from /tmp to avoid leftovers between runs
-
-      cleanup_pipes();
       cleanup_ipc();
 
     while (wait(NULL) > 0);
+#endif
 
     printf("All processes terminated. Exiting master process.\n");
 
-    return EXIT_SUCCESS;
+    return exit_code;
 
 }
 
 // ---------------- Assignment 3 (socket protocol) ----------------
 
-static int send_line(int sock, const char *line) {
-    // Protocol is line-based: message + '\n'
-    char tmp[1024];
-    size_t len = strlen(line);
-    if (len + 1 >= sizeof(tmp)) return -1;
-    memcpy(tmp, line, len);
-    tmp[len] = '\n';
-    tmp[len + 1] = '\0';
-
-    const char *p = tmp;
-    len = len + 1;
-    while (len > 0) {
-        ssize_t n = send(sock, p, len, 0);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        p += (size_t)n;
-        len -= (size_t)n;
-    }
-    return 0;
+// Protocol is line-based: message + '\n'. Lines are only queued; they leave
+// together when we next wait for the peer or at the end of the cycle.
+static int send_line(NetConn *c, const char *line) {
+    if (strlen(line) + 1 >= 1024) return -1;
+    return net_write_line(c, line);
 }
 
-static int recv_line(int sock, char *buf, size_t buflen) {
-    // Read until '\n' or buffer full-1.
-    size_t i = 0;
-    while (i + 1 < buflen) {
-        char c;
-        ssize_t n = recv(sock, &c, 1, 0);
-        if (n == 0) {
-            return 0; // closed
-        }
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        if (c == '\r') continue;
-        if (c == '\n') break;
-        buf[i++] = c;
-    }
-    buf[i] = '\0';
-    return 1;
+static int recv_line(NetConn *c, char *buf, size_t buflen) {
+    return net_read_line(c, buf, buflen);
 }
 
 static double clampd(double v, double lo, double hi) {
@@ -382,11 +577,11 @@ static double clampd(double v, double lo, double hi) {
     return v;
 }
 
-static void local_to_virtual(const newBlackboard *bb, int x, int y, double *vx, double *vy) {
+static void local_to_virtual(const BBWorld *world, int x, int y, double *vx, double *vy) {
     // Our internal coords are terminal-grid based (origin top-left).
     // For network exchange we map them to the [0..100] virtual world with origin bottom-left.
-    int play_w = bb_play_width(bb);
-    int play_h = bb_play_height(bb);
+    int play_w = bb_play_width(world);
+    int play_h = bb_play_height(world);
     int x0 = 1, x1 = play_w - 2;
     int y0 = 1, y1 = play_h - 2;
 
@@ -399,9 +594,9 @@ static void local_to_virtual(const newBlackboard *bb, int x, int y, double *vx,
     *vy = ny * VIRTUAL_WORLD_SIZE;
 }
 
-static void virtual_to_local(const newBlackboard *bb, double vx, double vy, int *x, int *y) {
-    int play_w = bb_play_width(bb);
-    int play_h = bb_play_height(bb);
+static void virtual_to_local(const BBWorld *world, double vx, double vy, int *x, int *y) {
+    int play_w = bb_play_width(world);
+    int play_h = bb_play_height(world);
     int x0 = 1, x1 = play_w - 2;
     int y0 = 1, y1 = play_h - 2;
 
@@ -419,12 +614,33 @@ static void virtual_to_local(const newBlackboard *bb, double vx, double vy, int
     *y = ly;
 }
 
+// Into the client's jitter buffer, in unrounded cells (call inside a net write
+// section). A state repeating the newest one is only kept as a keepalive, so
+// a fast stream of them doesn't push the history out of the buffer.
+static void remote_sample(newBlackboard *bb, const BBWorld *world, double vx, double vy) {
+    int play_w = bb_play_width(world);
+    int play_h = bb_play_height(world);
+    double x = 1.0 + clampd(vx / VIRTUAL_WORLD_SIZE, 0.0, 1.0) * (double)(play_w - 3);
+    double y = (double)(play_h - 2) - clampd(vy / VIRTUAL_WORLD_SIZE, 0.0, 1.0) * (double)(play_h - 3);
+    long long now = monotonic_ns();
+    BBNet *net = &bb->net;
+    if (net->remote_samples > 0) {
+        const BBNetSample *last = &net->remote_hist[(net->remote_samples - 1) & (NET_INTERP_SLOTS - 1)];
+        if (last->x == x && last->y == y && now - last->t_ns < NET_KEEPALIVE_MS * 1000000LL / 2) return;
+    }
+    BBNetSample *slot = &net->remote_hist[net->remote_samples & (NET_INTERP_SLOTS - 1)];
+    slot->t_ns = now;
+    slot->x = x;
+    slot->y = y;
+    net->remote_samples++;
+}
+
 static void *network_thread(void *arg) {
     net_args_t *na = (net_args_t*)arg;
     int sock = -1;
 
     if (na->is_server) {
-        int lsock = socket(AF_INET, SOCK_STREAM, 0);
+        int lsock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
         if (lsock < 0) return NULL;
         int opt = 1;
         setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
@@ -438,189 +654,874 @@ static void *network_thread(void *arg) {
             close(lsock);
             return NULL;
         }
-        if (listen(lsock, 1) < 0) {
+        if (listen(lsock, NET_MAX_PEERS) < 0) {
             close(lsock);
             return NULL;
         }
-        sock = accept(lsock, NULL, NULL);
+        server_session(na, lsock);
         close(lsock);
-        if (sock < 0) return NULL;
-    } else {
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) return NULL;
-        struct sockaddr_in addr;
-        memset(&addr, 0, sizeof(addr));
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons((uint16_t)na->port);
-        if (inet_pton(AF_INET, na->server_ip, &addr.sin_addr) != 1) {
-            close(sock);
-            return NULL;
-        }
-        if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-            close(sock);
-            return NULL;
-        }
+        return NULL;
+    }
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return NULL;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)na->port);
+    if (inet_pton(AF_INET, na->server_ip, &addr.sin_addr) != 1) {
+        close(sock);
+        return NULL;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return NULL;
     }
 
     char buf[256];
+    BBWorld world;          // lock-free copies of the sections we only read
+    BBDrone drone;
+
+    NetConn conn;           // buffered reads/writes on the socket, see net_proto.h
+    NetConn *c = &conn;
+    net_conn_init(c, sock);
+    int binary = 0;         // negotiated in the handshake, see net_proto.h
 
     // Handshake (pdf page 8)
-    if (na->is_server) {
-        if (send_line(sock, "ok") < 0) goto lost;
-        if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost;
-        if (strcmp(buf, "ook") != 0) goto lost;
-
-        // Wait until Window publishes a real terminal size, then send it.
-        int w = 0, h = 0;
-        for (int i = 0; i < 3000; i++) { // give the Window a bit of time to boot (~30s)
-            sem_wait(na->sem);
-            int ready = na->bb->win_ready;
-            w = na->bb->max_width;
-            h = na->bb->max_height;
-            sem_post(na->sem);
-            if (ready && w > 0 && h > 0) break;
-            usleep(10000);
-        }
-
-        snprintf(buf, sizeof(buf), "size %d %d", w, h);
-        if (send_line(sock, buf) < 0) goto lost;
-        if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost;
-        if (strcmp(buf, "sok") != 0) goto lost;
-
-        sem_wait(na->sem);
-        na->bb->net_lock_size = 1;
-        sem_post(na->sem);
-
-        net_size_ready = 1;
-    } else {
-        if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost;
-        if (strcmp(buf, "ok") != 0) goto lost;
-        if (send_line(sock, "ook") < 0) goto lost;
+    if (recv_line(c, buf, sizeof(buf)) <= 0) goto lost;
+    if (strcmp(buf, "ok") != 0) goto lost;
+    if (send_line(c, "ook") < 0) goto lost;
+
+    if (recv_line(c, buf, sizeof(buf)) <= 0) goto lost;
+    int w = 0, h = 0;
+    int parsed = 0;
+    if (!parsed && sscanf(buf, "size %d %d", &w, &h) == 2) parsed = 1;
+    if (!parsed && sscanf(buf, "size %d, %d", &w, &h) == 2) parsed = 1;
+    if (!parsed && sscanf(buf, "size %d,%d", &w, &h) == 2) parsed = 1;
+    if (!parsed) goto lost;
+
+    // Window owns bb->world (and may already be running: master stops
+    // waiting for us after ~12 s), so the size goes through our section and
+    // Window copies it in.
+    BB_WRITE_BEGIN(&na->bb->net);
+    na->bb->net.net_width = w;
+    na->bb->net.net_height = h;
+    na->bb->net.net_lock_size = 1;
+    BB_WRITE_END(&na->bb->net);
+
+    binary = (strstr(buf, " " NET_PROTO_TAG) != NULL);
+    if (send_line(c, binary ? "sok " NET_PROTO_TAG : "sok") < 0) goto lost;
+    net_size_ready = 1;
+
+    logger("Network: %s protocol", binary ? "binary " NET_PROTO_TAG : "line-based");
+
+    if (binary && binary_session(na, c) < 0) goto lost;
+
+    // Main exchange loop of the line-based protocol: lock-step with ACKs, as
+    // older servers expect. The server drives it, we answer.
+    while (!binary) {
+        int r = recv_line(c, buf, sizeof(buf));
+        if (r <= 0) goto lost;
+
+        if (strcmp(buf, "q") == 0) {
+            if (send_line(c, "qok") < 0) goto lost;
+            // Client must stop when server closes.
+            bb_quit(na->bb, na->sem);
+            net_lost = 1;
+            break;
+        }
 
-        if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost;
-        int w = 0, h = 0;
-        int parsed = 0;
-        if (!parsed && sscanf(buf, "size %d %d", &w, &h) == 2) parsed = 1;
-        if (!parsed && sscanf(buf, "size %d, %d", &w, &h) == 2) parsed = 1;
-        if (!parsed && sscanf(buf, "size %d,%d", &w, &h) == 2) parsed = 1;
-        if (!parsed) goto lost;
+        if (strcmp(buf, "drone") == 0) {
+            if (recv_line(c, buf, sizeof(buf)) <= 0) goto lost; // x y
+            double vx, vy;
+            if (sscanf(buf, "%lf %lf", &vx, &vy) == 2) {
+                int x, y;
+                BB_READ(&na->bb->world, world);
+                virtual_to_local(&world, vx, vy, &x, &y);
+                BB_WRITE_BEGIN(&na->bb->net);
+                na->bb->net.remote_drone_x = x;
+                na->bb->net.remote_drone_y = y;
+                remote_sample(na->bb, &world, vx, vy);
+                BB_WRITE_END(&na->bb->net);
+            }
+            if (send_line(c, "dok") < 0) goto lost;
+        } else if (strcmp(buf, "obst") == 0) {
+            // Send our drone position as obstacle
+            int x, y;
+            double vx, vy;
+            BB_READ(&na->bb->drone, drone);
+            BB_READ(&na->bb->world, world);
+            x = drone.drone_x;
+            y = drone.drone_y;
+            local_to_virtual(&world, x, y, &vx, &vy);
+            snprintf(buf, sizeof(buf), "%.6f %.6f", vx, vy);
+            if (send_line(c, buf) < 0) goto lost;
+            if (recv_line(c, buf, sizeof(buf)) <= 0) goto lost; // pok
+            if (strcmp(buf, "pok") != 0) goto lost;
+        }
+
+        if (net_flush(c) < 0) goto lost;   // answers queued this cycle go out before we sleep
+        usleep(30000); // ~33 Hz
+    }
+
+    net_flush(c);   // last qok/QUIT_OK
+    close(sock);
+    return NULL;
+
+lost:
+    net_lost = 1;
+    close(sock);
+    return NULL;
+}
+
+// Client side of an asynchronous binary session. Sending our drone and
+// receiving the server's state are independent streams: nothing waits for an
+// ACK, the ack field only tells the server how far we got.
+typedef struct {
+    uint32_t tx_seq, rx_seq;
+    int sent_x, sent_y;         // last drone position sent (local cells)
+    int my_id;                  // from WELCOME: our own entry in PEERS frames (-1: none yet)
+    long long last_tx, last_rx; // monotonic ns
+    int udp_fd;                 // BB_NET_UDP=1: positions over UDP (net_udp.h), -1 otherwise
+    int udp_up;                 // the server answered: our positions go over UDP too
+    uint32_t udp_token;         // from WELCOME, sent in our HELLOs
+    long long hello_at;
+    UdpStream us;
+} NetSync;
+
+// Shows what the server sent: id 0 is its drone, the others (all but our
+// own id) are the other clients, if the set carries them.
+static void show_remote(net_args_t *na, NetSync *ns, const PosSet *set, int with_peers) {
+    BBWorld world;
+    BB_READ(&na->bb->world, world);
+    int i0 = pos_set_find(set, 0);
+    if (i0 >= 0) {
+        int x, y;
+        double vx = set->x[i0] / NET_FIXED_SCALE, vy = set->y[i0] / NET_FIXED_SCALE;
+        virtual_to_local(&world, vx, vy, &x, &y);
+        BB_WRITE_BEGIN(&na->bb->net);
+        na->bb->net.remote_drone_x = x;
+        na->bb->net.remote_drone_y = y;
+        remote_sample(na->bb, &world, vx, vy);
+        BB_WRITE_END(&na->bb->net);
+    }
+    if (!with_peers) return;
+    int xs[NET_MAX_PEERS], ys[NET_MAX_PEERS], count = 0;
+    for (int i = 0; i < set->n && count < NET_MAX_PEERS; i++) {
+        if (set->id[i] == 0 || set->id[i] == ns->my_id) continue;
+        virtual_to_local(&world, set->x[i] / NET_FIXED_SCALE, set->y[i] / NET_FIXED_SCALE, &xs[count], &ys[count]);
+        count++;
+    }
+    BB_WRITE_BEGIN(&na->bb->net);
+    na->bb->net.n_peers = count;
+    memcpy(na->bb->net.peer_xs, xs, sizeof(int) * count);
+    memcpy(na->bb->net.peer_ys, ys, sizeof(int) * count);
+    BB_WRITE_END(&na->bb->net);
+}
 
-        sem_wait(na->sem);
-        na->bb->max_width = w;
-        na->bb->max_height = h;
-        na->bb->net_lock_size = 1;
-        sem_post(na->sem);
+// UDP socket towards the server's port, if BB_NET_UDP=1 asks for it.
+static void client_udp_open(NetConn *c, NetSync *ns, int epfd) {
+    const char *want = getenv("BB_NET_UDP");
+    if (!want || strcmp(want, "1") != 0 || ns->udp_fd >= 0) return;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(c->sock, (struct sockaddr*)&addr, &len) < 0) return;
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) return;
+    if (connect(fd, (struct sockaddr*)&addr, len) < 0) {
+        close(fd);
+        return;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    ns->udp_fd = fd;
+    logger("Network: asking the server for UDP");
+}
+
+// Returns 1 to keep going, 0 when the server quit.
+static int apply_frame(net_args_t *na, NetConn *c, NetSync *ns, NetFrame *f, int epfd) {
+    if (f->seq <= ns->rx_seq) return 1;     // stale: a newer state already won
+    ns->rx_seq = f->seq;
+    ns->last_rx = monotonic_ns();
+
+    PosSet set;
+    double vx, vy;
+    switch (f->type) {
+    case NET_MSG_QUIT:
+        f->type = NET_MSG_QUIT_OK;
+        f->len = 0;
+        f->seq = ++ns->tx_seq;
+        f->ack = ns->rx_seq;
+        net_send_frame(c, f);
+        // Client must stop when server closes.
+        bb_quit(na->bb, na->sem);
+        net_lost = 1;
+        return 0;
+    case NET_MSG_WELCOME:
+        if (f->len >= 2) ns->my_id = net_get_u16(f->payload);
+        if (f->len >= 6) {      // the server takes UDP too
+            ns->udp_token = net_get_u32(f->payload + 2);
+            client_udp_open(c, ns, epfd);
+        }
+        return 1;
+    case NET_MSG_PEERS: {
+        int n = net_peers_count(f);
+        if (n < 0) return 1;
+        set.n = 0;
+        for (int i = 0; i < n; i++) {
+            uint16_t id;
+            net_peers_get(f, i, &id, &vx, &vy);
+            pos_set_add(&set, id, vx, vy);
+        }
+        show_remote(na, ns, &set, 1);
+        return 1;
+    }
+    case NET_MSG_STATE:
+        if (net_state_decode(f, &vx, &vy) < 0) return 1;
+        set.n = 0;
+        pos_set_add(&set, 0, vx, vy);
+        show_remote(na, ns, &set, 0);
+        return 1;
+    }
+    return 1;   // unknown type from a newer server: skip it
+}
 
-        if (send_line(sock, "sok") < 0) goto lost;
-        net_size_ready = 1;
+// Binary protocol main loop (client): epoll over the non-blocking socket and
+// a 1 kHz timerfd. Every tick we send our drone if it moved (or as a
+// keepalive), and whatever the server sent is applied as soon as it arrives;
+// if the socket backs up we skip sends rather than queue stale positions.
+// Returns 0 after the server quit, -1 if the link is lost.
+static int binary_session(net_args_t *na, NetConn *c) {
+    int flags = fcntl(c->sock, F_GETFL, 0);
+    fcntl(c->sock, F_SETFL, flags | O_NONBLOCK);
+    int one = 1;
+    setsockopt(c->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // tiny frames, no batching
+
+    int epfd = epoll_create1(0);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (epfd < 0 || tfd < 0) {
+        if (epfd >= 0) close(epfd);
+        if (tfd >= 0) close(tfd);
+        return -1;
     }
+    struct itimerspec its = { { 0, NET_SEND_PERIOD_NS }, { 0, NET_SEND_PERIOD_NS } };
+    timerfd_settime(tfd, 0, &its, NULL);
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = c->sock };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c->sock, &ev);
+    struct epoll_event tev = { .events = EPOLLIN, .data.fd = tfd };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &tev);
+    int want_out = 0;
+
+    NetSync ns;
+    memset(&ns, 0, sizeof(ns));
+    ns.sent_x = ns.sent_y = -1;
+    ns.my_id = -1;
+    ns.last_rx = monotonic_ns();
+    ns.udp_fd = -1;
+    NetFrame f;
+    int result = -1;
 
-    // Main exchange loop
     while (1) {
-        if (na->is_server) {
-            // Quit?
-            sem_wait(na->sem);
-            int st = na->bb->state;
-            int x = na->bb->drone_x;
-            int y = na->bb->drone_y;
-            sem_post(na->sem);
-
-            if (st == 2) {
-                if (send_line(sock, "q") < 0) goto lost;
-                if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost; // qok
-                if (strcmp(buf, "qok") != 0) goto lost;
-                break;
+        struct epoll_event events[3];
+        int n = epoll_wait(epfd, events, 3, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int tick = 0, readable = 0;
+        for (int e = 0; e < n; e++) {
+            if (events[e].data.fd == tfd) {
+                unsigned long long expirations;
+                while (read(tfd, &expirations, sizeof(expirations)) > 0) {}
+                tick = 1;
+            } else if (events[e].data.fd == ns.udp_fd) {
+                PosSet set;
+                int r;
+                while ((r = udp_recv_frame(ns.udp_fd, &f, NULL)) != 0) {
+                    if (r < 0 || udp_decode(&ns.us, &f, &set) <= 0) continue;   // garbage, stale or base lost
+                    if (!ns.udp_up) logger("Network: positions now over UDP");
+                    ns.udp_up = 1;
+                    ns.last_rx = monotonic_ns();
+                    show_remote(na, &ns, &set, 1);
+                }
+            } else if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readable = 1;
             }
+        }
 
-            // Send drone position
-            if (send_line(sock, "drone") < 0) goto lost;
-            double vx, vy;
-            sem_wait(na->sem);
-            local_to_virtual(na->bb, x, y, &vx, &vy);
-            sem_post(na->sem);
-            snprintf(buf, sizeof(buf), "%.6f %.6f", vx, vy);
-            if (send_line(sock, buf) < 0) goto lost;
-            if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost; // dok
-            if (strcmp(buf, "dok") != 0) goto lost;
-
-            // Receive obstacle (client's drone)
-            if (send_line(sock, "obst") < 0) goto lost;
-            if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost; // x y
-            double ovx, ovy;
-            if (sscanf(buf, "%lf %lf", &ovx, &ovy) == 2) {
-                int ox, oy;
-                sem_wait(na->sem);
-                virtual_to_local(na->bb, ovx, ovy, &ox, &oy);
-                // single obstacle comes from client
-                for (int i = 0; i < MAX_OBJECTS; i++) {
-                    na->bb->obstacle_xs[i] = -1;
-                    na->bb->obstacle_ys[i] = -1;
+        if (readable) {
+            int done = 0, ok = 1;
+            while (ok && !done) {
+                int r;
+                while ((r = net_take_frame(c, &f)) == 1) {
+                    if (apply_frame(na, c, &ns, &f, epfd) == 0) {
+                        done = 1;
+                        break;
+                    }
                 }
-                na->bb->obstacle_xs[0] = ox;
-                na->bb->obstacle_ys[0] = oy;
-                na->bb->n_obstacles = 1;
-                sem_post(na->sem);
+                if (r < 0) ok = 0;
+                if (done || !ok) break;
+                ssize_t got = net_fill(c);
+                if (got > 0) continue;
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                ok = 0;     // closed or error
             }
-            if (send_line(sock, "pok") < 0) goto lost;
-        } else {
-            int r = recv_line(sock, buf, sizeof(buf));
-            if (r <= 0) goto lost;
-
-            if (strcmp(buf, "q") == 0) {
-                if (send_line(sock, "qok") < 0) goto lost;
-                // Client must stop when server closes.
-                sem_wait(na->sem);
-                na->bb->state = 2;
-                sem_post(na->sem);
-                net_lost = 1;
+            if (done) {
+                result = 0;
                 break;
             }
+            if (!ok) break;
+        }
 
-            if (strcmp(buf, "drone") == 0) {
-                if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost; // x y
-                double vx, vy;
-                if (sscanf(buf, "%lf %lf", &vx, &vy) == 2) {
-                    int x, y;
-                    sem_wait(na->sem);
-                    virtual_to_local(na->bb, vx, vy, &x, &y);
-                    na->bb->remote_drone_x = x;
-                    na->bb->remote_drone_y = y;
-                    sem_post(na->sem);
+        if (tick) {
+            long long now = monotonic_ns();
+            if (now - ns.last_rx > NET_PEER_TIMEOUT_MS * 1000000LL) break;
+            if (ns.udp_fd >= 0 && !ns.udp_up && now - ns.hello_at > NET_UDP_HELLO_MS * 1000000LL) {
+                f.type = NET_MSG_UDP_HELLO;
+                f.seq = f.ack = 0;
+                net_put_u32(f.payload, ns.udp_token);
+                f.len = 4;
+                udp_send_frame(ns.udp_fd, &f, NULL, 0);
+                ns.hello_at = now;
+            }
+            if (ns.udp_up) {
+                BBDrone drone;
+                BBWorld world;
+                BB_READ(&na->bb->drone, drone);
+                if (drone.drone_x != ns.sent_x || drone.drone_y != ns.sent_y ||
+                    now - ns.last_tx > NET_KEEPALIVE_MS * 1000000LL) {
+                    double vx, vy;
+                    PosSet set = { 0 };
+                    BB_READ(&na->bb->world, world);
+                    local_to_virtual(&world, drone.drone_x, drone.drone_y, &vx, &vy);
+                    pos_set_add(&set, 0, vx, vy);
+                    udp_encode(&ns.us, &set, &f, now);
+                    udp_send_frame(ns.udp_fd, &f, NULL, 0);     // a lost one is simply superseded
+                    ns.last_tx = now;
+                    ns.sent_x = drone.drone_x;
+                    ns.sent_y = drone.drone_y;
                 }
-                if (send_line(sock, "dok") < 0) goto lost;
-            } else if (strcmp(buf, "obst") == 0) {
-                // Send our drone position as obstacle
-                int x, y;
+            } else if (c->tx_head == c->tx_tail) {     // socket keeping up
+                BBDrone drone;
+                BBWorld world;
+                BB_READ(&na->bb->drone, drone);
+                if (drone.drone_x != ns.sent_x || drone.drone_y != ns.sent_y ||
+                    now - ns.last_tx > NET_KEEPALIVE_MS * 1000000LL) {
+                    double vx, vy;
+                    BB_READ(&na->bb->world, world);
+                    local_to_virtual(&world, drone.drone_x, drone.drone_y, &vx, &vy);
+                    f.type = NET_MSG_STATE;
+                    f.seq = ++ns.tx_seq;
+                    f.ack = ns.rx_seq;
+                    net_state_encode(&f, vx, vy);
+                    if (net_send_frame(c, &f) < 0) break;
+                    ns.last_tx = now;
+                    ns.sent_x = drone.drone_x;
+                    ns.sent_y = drone.drone_y;
+                }
+            }
+        }
+
+        int fr = net_flush(c);
+        if (fr < 0) break;
+        if (fr != want_out) {   // wait for room only while something is queued
+            want_out = fr;
+            ev.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+            epoll_ctl(epfd, EPOLL_CTL_MOD, c->sock, &ev);
+        }
+    }
+
+    if (result == 0) {
+        // Last QUIT_OK: give it a moment to leave before the socket closes.
+        fcntl(c->sock, F_SETFL, flags);
+        net_flush(c);
+    }
+    if (ns.udp_fd >= 0) close(ns.udp_fd);
+    close(tfd);
+    close(epfd);
+    return result;
+}
+
+// ---- Multi-client server ----
+// The server takes up to NET_MAX_PEERS clients, at any time. Each one runs a
+// small state machine over its own non-blocking NetConn: the text handshake,
+// then either the binary stream or, for older clients, the lock-step line
+// protocol driven from our side. One epoll loop with the 1 kHz timerfd runs
+// them all. Every client drone becomes an obstacle. What goes out (our drone,
+// the list of client drones) is serialized once per change and copied to each
+// binary client whose socket keeps up; a client that backs up is skipped and
+// gets the newest frames once it drains, never a queue of stale ones.
+// Clients leaving or dropping out don't end the server, only a local quit does.
+// Binary clients that ask for it (net_udp.h) get the positions as datagrams on
+// the same port number instead, one delta-coded stream per client.
+enum {
+    PEER_WAIT_OOK,      // sent "ok"
+    PEER_WAIT_SOK,      // sent "size W H bin1"
+    PEER_BINARY,
+    PEER_TEXT_IDLE,     // line protocol, between two cycles
+    PEER_TEXT_DOK,      // sent "drone" + position, waiting for "dok"
+    PEER_TEXT_POS,      // sent "obst", waiting for the client's position
+    PEER_QUITTING,      // sent QUIT / "q"
+};
+
+typedef struct {
+    NetConn conn;
+    int state;
+    int binary;
+    int want_out;               // EPOLLOUT armed
+    uint16_t id;
+    int has_pos, x, y;          // client drone, local cells
+    uint32_t rx_seq;
+    unsigned int state_sent, list_sent;     // versions of the shared frames it got
+    long long last_rx;          // monotonic ns
+    long long next_cycle;       // line protocol: when the next exchange starts
+    uint32_t token;             // from WELCOME: pairs its UDP HELLO with this connection
+    int udp;                    // positions go over UDP, to udp_addr
+    struct sockaddr_in udp_addr;
+    unsigned int set_sent;      // version of the position set it got
+    UdpStream us;
+} Peer;
+
+typedef struct {                // serialized once, sent to every binary client
+    unsigned char bytes[NET_HDR_LEN + NET_MAX_PAYLOAD];
+    size_t len;
+    unsigned int version;       // 0: nothing serialized yet
+} SharedFrame;
+
+typedef struct {
+    net_args_t *na;
+    ObjectPool pool;
+    int epfd;
+    Peer *peers[NET_MAX_PEERS];
+    uint16_t next_id;
+    uint32_t tx_seq;            // one sequence for everything we send (seq only has to grow per client)
+    SharedFrame state, list;
+    int sent_x, sent_y;         // our drone in the current state frame
+    long long state_at;         // when the state frame was serialized
+    int peers_dirty;            // a client drone moved, joined or left
+    int quitting;
+    long long quit_deadline;
+    char size_line[64];
+    int udp_fd;                 // -1: TCP only
+    PosSet set;                 // our drone (id 0) + client drones, for the UDP clients
+    unsigned int set_version, set_state, set_list;  // and the frame versions it was built from
+} NetServer;
+
+#define PEER_EV(i) ((uint32_t)(i) + 3)     // epoll data: 0 listen socket, 1 timer, 2 UDP socket, 3.. peers
+
+static void peer_drop(NetServer *s, int i, const char *why) {
+    Peer *p = s->peers[i];
+    logger("Network: client %u %s", p->id, why);
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, p->conn.sock, NULL);
+    close(p->conn.sock);
+    if (p->has_pos) s->peers_dirty = 1;
+    free(p);
+    s->peers[i] = NULL;
+}
+
+static int peer_send(NetServer *s, Peer *p, NetFrame *f) {
+    f->seq = ++s->tx_seq;
+    f->ack = p->rx_seq;
+    return net_send_frame(&p->conn, f);
+}
+
+// A shared frame with this client's seq/ack patched in (seq has to be ours at
+// send time: the client drops anything older than what it already has).
+static int peer_send_shared(NetServer *s, Peer *p, const SharedFrame *sf) {
+    unsigned char bytes[NET_HDR_LEN + NET_MAX_PAYLOAD];
+    memcpy(bytes, sf->bytes, sf->len);
+    net_put_u32(bytes + 4, ++s->tx_seq);
+    net_put_u32(bytes + 8, p->rx_seq);
+    return net_write(&p->conn, bytes, sf->len);
+}
+
+static void peer_set_pos(NetServer *s, Peer *p, double vx, double vy) {
+    BBWorld world;
+    int x, y;
+    BB_READ(&s->na->bb->world, world);
+    virtual_to_local(&world, vx, vy, &x, &y);
+    if (p->has_pos && x == p->x && y == p->y) return;
+    p->has_pos = 1;
+    p->x = x;
+    p->y = y;
+    s->peers_dirty = 1;
+}
+
+static void server_accept(NetServer *s, int lsock) {
+    int sock;
+    while ((sock = accept(lsock, NULL, NULL)) >= 0) {
+        int i = 0;
+        while (i < NET_MAX_PEERS && s->peers[i]) i++;
+        Peer *p = (i < NET_MAX_PEERS && !s->quitting) ? calloc(1, sizeof(Peer)) : NULL;
+        if (!p) {
+            close(sock);    // full (or shutting down)
+            continue;
+        }
+        int one = 1;
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        net_conn_init(&p->conn, sock);
+        p->id = ++s->next_id;
+        // Not a secret, it only tells which connection a HELLO belongs to.
+        p->token = (uint32_t)(monotonic_ns() * 2654435761ULL) ^ ((uint32_t)p->id << 16);
+        p->state = PEER_WAIT_OOK;
+        p->last_rx = monotonic_ns();
+        s->peers[i] = p;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = PEER_EV(i) };
+        epoll_ctl(s->epfd, EPOLL_CTL_ADD, sock, &ev);
+        send_line(&p->conn, "ok");
+        logger("Network: client %u connected", p->id);
+    }
+}
+
+// Consumes whatever the client sent. Returns 0, or -1 to drop it.
+static int peer_input(NetServer *s, Peer *p) {
+    char buf[256];
+    NetFrame f;
+    long long now = monotonic_ns();
+    for (;;) {
+        int r;
+        if (p->binary) {
+            while ((r = net_take_frame(&p->conn, &f)) == 1) {
+                p->last_rx = now;
+                if (f.seq <= p->rx_seq) continue;  // stale
+                p->rx_seq = f.seq;
                 double vx, vy;
-                sem_wait(na->sem);
-                x = na->bb->drone_x;
-                y = na->bb->drone_y;
-                local_to_virtual(na->bb, x, y, &vx, &vy);
-                sem_post(na->sem);
-                snprintf(buf, sizeof(buf), "%.6f %.6f", vx, vy);
-                if (send_line(sock, buf) < 0) goto lost;
-                if (recv_line(sock, buf, sizeof(buf)) <= 0) goto lost; // pok
-                if (strcmp(buf, "pok") != 0) goto lost;
+                if (f.type == NET_MSG_QUIT_OK && p->state == PEER_QUITTING) return -1;
+                if (net_state_decode(&f, &vx, &vy) == 0) peer_set_pos(s, p, vx, vy);
             }
+            if (r < 0) return -1;
+        } else {
+            while ((r = net_take_line(&p->conn, buf, sizeof(buf))) == 1) {
+                p->last_rx = now;
+                double vx, vy;
+                switch (p->state) {
+                case PEER_WAIT_OOK:
+                    if (strcmp(buf, "ook") != 0) return -1;
+                    send_line(&p->conn, s->size_line);
+                    p->state = PEER_WAIT_SOK;
+                    break;
+                case PEER_WAIT_SOK:
+                    if (strcmp(buf, "sok " NET_PROTO_TAG) == 0) {
+                        p->binary = 1;
+                        p->state = PEER_BINARY;
+                        f.type = NET_MSG_WELCOME;
+                        net_put_u16(f.payload, p->id);
+                        f.len = 2;
+                        if (s->udp_fd >= 0) {   // older bin1 clients only read the id
+                            net_put_u32(f.payload + 2, p->token);
+                            f.len = 6;
+                        }
+                        peer_send(s, p, &f);
+                    } else if (strcmp(buf, "sok") == 0) {
+                        p->state = PEER_TEXT_IDLE;
+                        p->next_cycle = now;
+                    } else {
+                        return -1;
+                    }
+                    logger("Network: client %u speaks the %s protocol", p->id, p->binary ? "binary " NET_PROTO_TAG : "line-based");
+                    break;
+                case PEER_TEXT_DOK:
+                    if (strcmp(buf, "dok") != 0) return -1;
+                    send_line(&p->conn, "obst");
+                    p->state = PEER_TEXT_POS;
+                    break;
+                case PEER_TEXT_POS:
+                    if (sscanf(buf, "%lf %lf", &vx, &vy) == 2) peer_set_pos(s, p, vx, vy);
+                    send_line(&p->conn, "pok");
+                    p->state = PEER_TEXT_IDLE;
+                    p->next_cycle += 30000000LL;   // ~33 Hz
+                    if (p->next_cycle < now) p->next_cycle = now;
+                    break;
+                case PEER_QUITTING:
+                    if (strcmp(buf, "qok") == 0) return -1;
+                    break;
+                default:
+                    return -1;  // talking out of turn
+                }
+                if (p->binary) break;   // the rest of the buffer is frames
+            }
+            if (p->binary) continue;
         }
+        ssize_t got = net_fill(&p->conn);
+        if (got > 0) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;      // closed or error
+    }
+}
 
-        usleep(30000); // ~33 Hz
+// Datagrams: HELLOs switching a binary client to UDP, then its position stream.
+static void server_udp_input(NetServer *s) {
+    struct sockaddr_in from;
+    NetFrame f;
+    PosSet set;
+    long long now = monotonic_ns();
+    int r;
+    while ((r = udp_recv_frame(s->udp_fd, &f, &from)) != 0) {
+        if (r < 0) continue;
+        Peer *p = NULL;
+        for (int i = 0; i < NET_MAX_PEERS && !p; i++) {
+            Peer *q = s->peers[i];
+            if (!q || q->state != PEER_BINARY) continue;
+            if (f.type == NET_MSG_UDP_HELLO ? (f.len >= 4 && net_get_u32(f.payload) == q->token)
+                                            : (q->udp && q->udp_addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+                                               q->udp_addr.sin_port == from.sin_port)) p = q;
+        }
+        if (!p) continue;   // unknown sender
+        p->last_rx = now;
+        if (f.type == NET_MSG_UDP_HELLO) {
+            if (!p->udp) logger("Network: client %u switched to UDP", p->id);
+            p->udp = 1;
+            p->udp_addr = from;     // repeated HELLOs may come from a new address (NAT)
+            p->set_sent = 0;        // answer right away, that's what ends the HELLOs
+            continue;
+        }
+        int k;
+        if (udp_decode(&p->us, &f, &set) == 1 && (k = pos_set_find(&set, 0)) >= 0) {
+            peer_set_pos(s, p, set.x[k] / NET_FIXED_SCALE, set.y[k] / NET_FIXED_SCALE);
+        }
     }
+}
 
-    if (sock >= 0) close(sock);
-    return NULL;
+// Client drones -> obstacles, and a new PEERS frame for the binary clients.
+static void server_publish_peers(NetServer *s) {
+    BBWorld world;
+    BB_READ(&s->na->bb->world, world);
+    int xs[NET_MAX_PEERS], ys[NET_MAX_PEERS], n = 0;
+    NetFrame f;
+    net_peers_begin(&f);
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        Peer *p = s->peers[i];
+        if (!p || !p->has_pos) continue;
+        xs[n] = p->x;
+        ys[n] = p->y;
+        n++;
+        double vx, vy;
+        local_to_virtual(&world, p->x, p->y, &vx, &vy);
+        net_peers_add(&f, p->id, vx, vy);
+    }
+    pool_sync(&s->pool, s->na->bb);
+    if (n > pool_capacity(&s->pool)) n = pool_capacity(&s->pool);
+    pool_publish_objects(&s->pool, s->na->bb, OBJ_OBSTACLES, xs, ys, n, NULL, 0, 0);
+
+    f.seq = f.ack = 0;  // patched per client
+    s->list.len = net_frame_bytes(&f, s->list.bytes);
+    s->list.version++;
+    s->peers_dirty = 0;
+}
 
-lost:
-    net_lost = 1;
-    if (sock >= 0) close(sock);
-    return NULL;
+static void server_tick(NetServer *s) {
+    long long now = monotonic_ns();
+    net_args_t *na = s->na;
+    NetFrame f;
+
+    if (!s->quitting) {
+        if (bb_quit_requested(na->bb)) {
+            s->quitting = 1;
+            s->quit_deadline = now + NET_QUIT_TIMEOUT_MS * 1000000LL;
+        }
+    }
+
+    // Our drone: re-serialized when it moves, or as a keepalive.
+    BBDrone drone;
+    BB_READ(&na->bb->drone, drone);
+    if (!s->quitting && (s->state.version == 0 || drone.drone_x != s->sent_x || drone.drone_y != s->sent_y ||
+                         now - s->state_at > NET_KEEPALIVE_MS * 1000000LL)) {
+        BBWorld world;
+        double vx, vy;
+        BB_READ(&na->bb->world, world);
+        local_to_virtual(&world, drone.drone_x, drone.drone_y, &vx, &vy);
+        f.type = NET_MSG_STATE;
+        f.seq = f.ack = 0;  // patched per client
+        net_state_encode(&f, vx, vy);
+        s->state.len = net_frame_bytes(&f, s->state.bytes);
+        s->state.version++;
+        s->sent_x = drone.drone_x;
+        s->sent_y = drone.drone_y;
+        s->state_at = now;
+    }
+    if (s->peers_dirty) server_publish_peers(s);
+    if (s->udp_fd >= 0 && (s->set_state != s->state.version || s->set_list != s->list.version)) {
+        BBWorld world;
+        double vx, vy;
+        BB_READ(&na->bb->world, world);
+        s->set.n = 0;
+        local_to_virtual(&world, s->sent_x, s->sent_y, &vx, &vy);
+        pos_set_add(&s->set, 0, vx, vy);
+        for (int i = 0; i < NET_MAX_PEERS; i++) {
+            Peer *p = s->peers[i];
+            if (!p || !p->has_pos) continue;
+            local_to_virtual(&world, p->x, p->y, &vx, &vy);
+            pos_set_add(&s->set, p->id, vx, vy);
+        }
+        s->set_state = s->state.version;
+        s->set_list = s->list.version;
+        s->set_version++;
+    }
+
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        Peer *p = s->peers[i];
+        if (!p) continue;
+        if (now - p->last_rx > NET_PEER_TIMEOUT_MS * 1000000LL) {
+            peer_drop(s, i, "timed out");
+            continue;
+        }
+        if (s->quitting && p->state != PEER_QUITTING) {
+            if (p->state == PEER_WAIT_OOK || p->state == PEER_WAIT_SOK) {
+                peer_drop(s, i, "dropped during shutdown");
+                continue;
+            }
+            if (p->binary) {
+                f.type = NET_MSG_QUIT;
+                f.len = 0;
+                peer_send(s, p, &f);
+                p->state = PEER_QUITTING;
+            } else if (p->state == PEER_TEXT_IDLE) {   // mid-cycle ones finish their cycle first
+                send_line(&p->conn, "q");
+                p->state = PEER_QUITTING;
+            }
+        } else if (p->state == PEER_BINARY && p->udp) {
+            // Set changes and the state keepalive both bump set_version.
+            if (p->set_sent != s->set_version) {
+                udp_encode(&p->us, &s->set, &f, now);
+                udp_send_frame(s->udp_fd, &f, (struct sockaddr*)&p->udp_addr, sizeof(p->udp_addr));
+                p->set_sent = s->set_version;
+            }
+        } else if (p->state == PEER_BINARY && p->conn.tx_head == p->conn.tx_tail) {
+            // Only to clients that kept up; the others get the newest frames once they drain.
+            if (p->state_sent != s->state.version && peer_send_shared(s, p, &s->state) == 0) p->state_sent = s->state.version;
+            if (s->list.version && p->list_sent != s->list.version && peer_send_shared(s, p, &s->list) == 0) p->list_sent = s->list.version;
+        } else if (p->state == PEER_TEXT_IDLE && now >= p->next_cycle) {
+            char buf[64];
+            BBWorld world;
+            double vx, vy;
+            BB_READ(&na->bb->world, world);
+            local_to_virtual(&world, drone.drone_x, drone.drone_y, &vx, &vy);
+            snprintf(buf, sizeof(buf), "%.6f %.6f", vx, vy);
+            send_line(&p->conn, "drone");
+            send_line(&p->conn, buf);
+            p->state = PEER_TEXT_DOK;
+        }
+    }
 }
 
+// Runs the server until a local quit. Returns 0, -1 if it couldn't start.
+static int server_session(net_args_t *na, int lsock) {
+    static NetServer server;
+    NetServer *s = &server;
+    memset(s, 0, sizeof(*s));
+    s->na = na;
+    s->pool.fd = -1;
+    if (pool_open(&s->pool, na->bb) == -1) return -1;   // we own the obstacles in network mode
+
+    // Wait until Window publishes a real terminal size: every client gets it.
+    BBWorld world;
+    int w = 0, h = 0;
+    for (int i = 0; i < 3000; i++) { // give the Window a bit of time to boot (~30s)
+        BB_READ(&na->bb->world, world);
+        w = world.max_width;
+        h = world.max_height;
+        if (world.win_ready && w > 0 && h > 0) break;
+        usleep(10000);
+    }
+    // Offer the binary protocol; a client that doesn't know it answers a plain "sok".
+    snprintf(s->size_line, sizeof(s->size_line), "size %d %d %s", w, h, NET_PROTO_TAG);
+    BB_WRITE_BEGIN(&na->bb->net);
+    na->bb->net.net_lock_size = 1;
+    BB_WRITE_END(&na->bb->net);
+    net_size_ready = 1;
+
+    s->epfd = epoll_create1(0);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (s->epfd < 0 || tfd < 0) {
+        if (s->epfd >= 0) close(s->epfd);
+        if (tfd >= 0) close(tfd);
+        pool_close(&s->pool);
+        return -1;
+    }
+    struct itimerspec its = { { 0, NET_SEND_PERIOD_NS }, { 0, NET_SEND_PERIOD_NS } };
+    timerfd_settime(tfd, 0, &its, NULL);
+    struct epoll_event lev = { .events = EPOLLIN, .data.u32 = 0 };
+    epoll_ctl(s->epfd, EPOLL_CTL_ADD, lsock, &lev);
+    struct epoll_event tev = { .events = EPOLLIN, .data.u32 = 1 };
+    epoll_ctl(s->epfd, EPOLL_CTL_ADD, tfd, &tev);
+
+    // UDP on the same port number, for the clients that want it. Optional.
+    s->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_in uaddr = { .sin_family = AF_INET, .sin_addr.s_addr = INADDR_ANY, .sin_port = htons(na->port) };
+    if (s->udp_fd >= 0 && bind(s->udp_fd, (struct sockaddr*)&uaddr, sizeof(uaddr)) < 0) {
+        close(s->udp_fd);
+        s->udp_fd = -1;
+    }
+    if (s->udp_fd >= 0) {
+        struct epoll_event uev = { .events = EPOLLIN, .data.u32 = 2 };
+        epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->udp_fd, &uev);
+    } else {
+        log_at(LOG_WARN, "Network: no UDP on port %d, TCP only", na->port);
+    }
+    logger("Network: server listening on port %d (up to %d clients)", na->port, NET_MAX_PEERS);
+
+    struct epoll_event events[NET_MAX_PEERS + 3];
+    while (1) {
+        int n = epoll_wait(s->epfd, events, NET_MAX_PEERS + 3, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int tick = 0;
+        for (int e = 0; e < n; e++) {
+            uint32_t id = events[e].data.u32;
+            if (id == 0) {
+                server_accept(s, lsock);
+            } else if (id == 1) {
+                unsigned long long expirations;
+                while (read(tfd, &expirations, sizeof(expirations)) > 0) {}
+                tick = 1;
+            } else if (id == 2) {
+                server_udp_input(s);
+            } else if (s->peers[id - 3] && (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                Peer *p = s->peers[id - 3];
+                if (peer_input(s, p) < 0) peer_drop(s, id - 3, p->state == PEER_QUITTING ? "left" : "disconnected");
+            }
+        }
+        if (tick) server_tick(s);
+
+        int active = 0;
+        for (int i = 0; i < NET_MAX_PEERS; i++) {
+            Peer *p = s->peers[i];
+            if (!p) continue;
+            int fr = net_flush(&p->conn);
+            if (fr < 0) {
+                peer_drop(s, i, "disconnected");
+                continue;
+            }
+            active++;
+            if (fr != p->want_out) {    // wait for room only while something is queued
+                p->want_out = fr;
+                struct epoll_event ev = { .events = EPOLLIN | (fr ? EPOLLOUT : 0), .data.u32 = PEER_EV(i) };
+                epoll_ctl(s->epfd, EPOLL_CTL_MOD, p->conn.sock, &ev);
+            }
+        }
+        if (s->quitting && (active == 0 || monotonic_ns() > s->quit_deadline)) break;
+    }
+
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        if (s->peers[i]) peer_drop(s, i, "closed at shutdown");
+    }
+    if (s->udp_fd >= 0) close(s->udp_fd);
+    close(tfd);
+    close(s->epfd);
+    pool_close(&s->pool);
+    return 0;
+}
+
+#ifndef BB_ENGINE
 static int command_exists(const char *cmd) {
     char buf[256];
     snprintf(buf, sizeof(buf), "command -v %s >/dev/null 2>&1", cmd);
     return system(buf) == 0;
 }
+#endif
 
 void summon(char *args[]) {
     if (execvp(args[0], args) == -1) {
@@ -629,7 +1530,7 @@ void summon(char *args[]) {
     }
 }
 
-void read_json(newBlackboard *bb, bool first_time) {
+void read_json(BBConfig *cfg, bool first_time) {
     const char *filename = JSON_PATH;
     FILE *file = fopen(filename, "r");
     if (!file) {
@@ -651,22 +1552,26 @@ void read_json(newBlackboard *bb, bool first_time) {
         printf("Error parsing JSON: %s\n", cJSON_GetErrorPtr());
     }
     cJSON *item;  // TODO CHECK FOR NULL and CORRUPTED JSON
-    if ((item = cJSON_GetObjectItem(json, "num_obstacles")))    bb->n_obstacles = item->valueint;
-    if ((item = cJSON_GetObjectItem(json, "num_targets")))      bb->n_targets = item->valueint;
-    if ((item = cJSON_GetObjectItem(json, "mass")))             bb->physix.mass = item->valueint;
-    if ((item = cJSON_GetObjectItem(json, "visc_damp_coef")))   bb->physix.visc_damp_coef = item->valueint;
-    if ((item = cJSON_GetObjectItem(json, "obst_repl_coef")))   bb->physix.obst_repl_coef = item->valueint;
-    if ((item = cJSON_GetObjectItem(json, "radius")))           bb->physix.radius = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "num_obstacles")))    cfg->n_obstacles = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "num_targets")))      cfg->n_targets = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "mass")))             cfg->physix.mass = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "visc_damp_coef")))   cfg->physix.visc_damp_coef = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "obst_repl_coef")))   cfg->physix.obst_repl_coef = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "radius")))           cfg->physix.radius = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "max_objects")))      cfg->max_objects = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "net_interp_delay_ms"))) cfg->net_interp_delay_ms = item->valueint;
+    if ((item = cJSON_GetObjectItem(json, "watchdog_deadlines_ms"))) {
+        for (int i = 0; i < WD_COMPONENTS; i++) {
+            cJSON *ms = cJSON_GetObjectItem(item, WD_NAMES[i]);
+            if (ms) cfg->wd_deadline_ms[i] = ms->valueint;
+        }
+    }
     cJSON_Delete(json);
     free(data);
 }
 
-double calculate_score(newBlackboard *bb) {
-    double score = (double)bb->stats.hit_targets        * 30.0 -
-                   (double)bb->stats.hit_obstacles      * 5.0 -
-                   bb->stats.time_elapsed               * 0.05 -
-                   bb->stats.distance_traveled          * 0.1;
-    return score;
+double calculate_score(const Stats *stats) {
+    return physics_score(stats);    // batch scores its worlds with it too
 }
 
 void initialize_logger() {
@@ -679,45 +1584,17 @@ void initialize_logger() {
     } else {
         printf("No existing simulation.log file found.\n");
     }
-    if (!log_file) {
-        log_file = fopen("./logs/simulation.log", "a");
-        if (!log_file) {
-            perror("Unable to open log file");
-            return;
-        }
-    }
+    // The file itself is opened by the log writer thread on the first logger() call.
 }
 
 void cleanup_logger() {
-    pthread_mutex_lock(&logger_mutex);
-    if (log_file) {
-        fclose(log_file);
-        log_file = NULL;
-    }
-    pthread_mutex_unlock(&logger_mutex);
-}
-
-void create_named_pipe(const char *pipe_name) {
-    if (access(pipe_name, F_OK) == -1) {
-        if (mkfifo(pipe_name, 0666) == -1) {
-            perror("Failed to create named pipe");
-            exit(EXIT_FAILURE);
-        }
-    }
-}
-
-void cleanup_pipes(void) {
-    unlink(PIPE_BLACKBOARD);
-    unlink(PIPE_DYNAMICS);
-    unlink(PIPE_KEYBOARD);
-    unlink(PIPE_WINDOW);
-    unlink(PIPE_OBSTACLE);
-    unlink(PIPE_TARGET);
+    log_shutdown();     // flushes whatever is still queued
 }
 
 void cleanup_ipc(void) {
     sem_unlink(SEM_NAME);
     shm_unlink(SHM_NAME);
+    shm_unlink(POOL_SHM_NAME);
 }
 
 void handle_sigchld(int sig) {
@@ -0,0 +1,228 @@
+#ifndef NET_UDP_H
+#define NET_UDP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include "blackboard.h"
+#include "net_proto.h"
+
+// Optional UDP transport for the position stream of a binary session
+// (a client asks for it with BB_NET_UDP=1). TCP stays up for the handshake,
+// WELCOME and the quit; only drone positions move to datagrams, so a lost
+// packet no longer holds back the ones behind it.
+//
+// A stream carries a set of positions (id + fixed-point x/y): the client sends
+// its own drone as id 0, the server its drone as id 0 plus every client drone
+// under its PEERS id. Datagrams use the TCP frame header and are either
+//
+//   SNAPSHOT  u16 count, count * (u16 id, i32 x, i32 y)
+//   DELTA     u32 base, u16 count, count * (u16 id, i16 dx, i16 dy)
+//
+// where a DELTA is quantized (NET_DELTA_QUANT fixed-point steps per unit) and
+// taken against base, the newest of our snapshots the receiver acknowledged
+// (ack = newest snapshot seq it received). Entries that didn't move since the
+// base are left out, a removed one is sent as NET_DELTA_GONE. Positions are
+// latest-wins: nothing is retransmitted, datagrams older than the last applied
+// one are dropped, and a full snapshot goes out at least every NET_SNAPSHOT_MS
+// (or whenever a delta can't express the change), which also resyncs a
+// receiver that lost its base.
+#define NET_SET_MAX (NET_MAX_PEERS + 1)     // server drone + every client
+#define NET_SNAP_RING 8             // snapshots remembered per direction (power of two)
+#define NET_SNAPSHOT_MS 100
+#define NET_DELTA_QUANT 1000        // 1/1000 of a virtual unit, well below one cell
+#define NET_DELTA_GONE INT16_MIN
+#define NET_UDP_HELLO_MS 50         // client: HELLO repeat until the first datagram arrives
+
+enum {
+    NET_MSG_UDP_HELLO = 16,     // client -> server datagram: u32 token from WELCOME
+    NET_MSG_SNAPSHOT,
+    NET_MSG_DELTA,
+};
+
+typedef struct {
+    int n;
+    uint16_t id[NET_SET_MAX];
+    int32_t x[NET_SET_MAX], y[NET_SET_MAX];     // NET_FIXED_SCALE fixed point
+} PosSet;
+
+typedef struct {
+    uint32_t seq;               // 0: empty slot
+    PosSet set;
+} SnapSlot;
+
+typedef struct {
+    // sending side
+    uint32_t tx_seq;
+    uint32_t acked;             // newest of our snapshots the peer has
+    long long last_snapshot;    // monotonic ns
+    SnapSlot sent[NET_SNAP_RING];
+    // receiving side
+    uint32_t rx_seq;            // newest datagram applied; anything older is dropped
+    uint32_t rx_snapshot;       // newest snapshot received: what we ack
+    SnapSlot got[NET_SNAP_RING];
+} UdpStream;
+
+static inline void pos_set_add(PosSet *s, uint16_t id, double vx, double vy) {
+    if (s->n >= NET_SET_MAX) return;
+    s->id[s->n] = id;
+    s->x[s->n] = (int32_t)lround(vx * NET_FIXED_SCALE);
+    s->y[s->n] = (int32_t)lround(vy * NET_FIXED_SCALE);
+    s->n++;
+}
+
+static inline int pos_set_find(const PosSet *s, uint16_t id) {
+    for (int i = 0; i < s->n; i++) {
+        if (s->id[i] == id) return i;
+    }
+    return -1;
+}
+
+static inline void udp_encode_snapshot(UdpStream *us, const PosSet *cur, NetFrame *f, long long now) {
+    f->type = NET_MSG_SNAPSHOT;
+    f->seq = ++us->tx_seq;
+    net_put_u16(f->payload, (uint16_t)cur->n);
+    unsigned char *e = f->payload + 2;
+    for (int i = 0; i < cur->n; i++, e += 10) {
+        net_put_u16(e, cur->id[i]);
+        net_put_u32(e + 2, (uint32_t)cur->x[i]);
+        net_put_u32(e + 6, (uint32_t)cur->y[i]);
+    }
+    f->len = (uint16_t)(e - f->payload);
+    SnapSlot *slot = &us->sent[f->seq & (NET_SNAP_RING - 1)];
+    slot->seq = f->seq;
+    slot->set = *cur;
+    us->last_snapshot = now;
+}
+
+// Quantized step from base to v, or NET_DELTA_GONE if it doesn't fit.
+static inline int16_t udp_delta(int32_t base, int32_t v) {
+    long long d = llround((double)((long long)v - base) / NET_DELTA_QUANT);
+    return (d > INT16_MIN && d <= INT16_MAX) ? (int16_t)d : NET_DELTA_GONE;
+}
+
+// Next datagram for cur: a delta against the acked snapshot when possible,
+// otherwise a snapshot. The ack for the other direction is filled in too.
+static inline void udp_encode(UdpStream *us, const PosSet *cur, NetFrame *f, long long now) {
+    f->ack = us->rx_snapshot;
+    const SnapSlot *base = &us->sent[us->acked & (NET_SNAP_RING - 1)];
+    if (us->acked == 0 || base->seq != us->acked || now - us->last_snapshot > NET_SNAPSHOT_MS * 1000000LL) {
+        udp_encode_snapshot(us, cur, f, now);
+        return;
+    }
+    unsigned char *e = f->payload + 6;
+    int count = 0;
+    for (int i = 0; i < cur->n; i++) {
+        int b = pos_set_find(&base->set, cur->id[i]);
+        if (b < 0) {        // new entry: deltas can't add one
+            udp_encode_snapshot(us, cur, f, now);
+            return;
+        }
+        int16_t dx = udp_delta(base->set.x[b], cur->x[i]);
+        int16_t dy = udp_delta(base->set.y[b], cur->y[i]);
+        if (dx == NET_DELTA_GONE || dy == NET_DELTA_GONE) {
+            udp_encode_snapshot(us, cur, f, now);
+            return;
+        }
+        if (dx == 0 && dy == 0) continue;
+        net_put_u16(e, cur->id[i]);
+        net_put_u16(e + 2, (uint16_t)dx);
+        net_put_u16(e + 4, (uint16_t)dy);
+        e += 6;
+        count++;
+    }
+    for (int b = 0; b < base->set.n; b++) {
+        if (pos_set_find(cur, base->set.id[b]) >= 0) continue;
+        net_put_u16(e, base->set.id[b]);
+        net_put_u16(e + 2, (uint16_t)NET_DELTA_GONE);
+        net_put_u16(e + 4, (uint16_t)NET_DELTA_GONE);
+        e += 6;
+        count++;
+    }
+    f->type = NET_MSG_DELTA;
+    f->seq = ++us->tx_seq;
+    net_put_u32(f->payload, us->acked);
+    net_put_u16(f->payload + 4, (uint16_t)count);
+    f->len = (uint16_t)(e - f->payload);
+}
+
+// Returns 1 with the new set in out, 0 if the datagram is stale or its base is
+// gone (it is dropped), -1 if it is malformed.
+static inline int udp_decode(UdpStream *us, const NetFrame *f, PosSet *out) {
+    if (f->type != NET_MSG_SNAPSHOT && f->type != NET_MSG_DELTA) return -1;
+    if (f->ack > us->acked && us->sent[f->ack & (NET_SNAP_RING - 1)].seq == f->ack) us->acked = f->ack;
+    if (f->seq <= us->rx_seq) return 0;
+
+    if (f->type == NET_MSG_SNAPSHOT) {
+        if (f->len < 2) return -1;
+        int n = net_get_u16(f->payload);
+        if (n > NET_SET_MAX || 2 + n * 10 > f->len) return -1;
+        const unsigned char *e = f->payload + 2;
+        out->n = n;
+        for (int i = 0; i < n; i++, e += 10) {
+            out->id[i] = net_get_u16(e);
+            out->x[i] = (int32_t)net_get_u32(e + 2);
+            out->y[i] = (int32_t)net_get_u32(e + 6);
+        }
+        SnapSlot *slot = &us->got[f->seq & (NET_SNAP_RING - 1)];
+        slot->seq = f->seq;
+        slot->set = *out;
+        if (f->seq > us->rx_snapshot) us->rx_snapshot = f->seq;
+        us->rx_seq = f->seq;
+        return 1;
+    }
+
+    if (f->len < 6) return -1;
+    uint32_t base_seq = net_get_u32(f->payload);
+    int n = net_get_u16(f->payload + 4);
+    if (6 + n * 6 > f->len) return -1;
+    const SnapSlot *base = &us->got[base_seq & (NET_SNAP_RING - 1)];
+    if (base_seq == 0 || base->seq != base_seq) return 0;
+    *out = base->set;
+    const unsigned char *e = f->payload + 6;
+    for (int k = 0; k < n; k++, e += 6) {
+        uint16_t id = net_get_u16(e);
+        int16_t dx = (int16_t)net_get_u16(e + 2);
+        int16_t dy = (int16_t)net_get_u16(e + 4);
+        int i = pos_set_find(out, id);
+        if (i < 0) continue;
+        if (dx == NET_DELTA_GONE) {
+            out->n--;
+            out->id[i] = out->id[out->n];
+            out->x[i] = out->x[out->n];
+            out->y[i] = out->y[out->n];
+            continue;
+        }
+        out->x[i] = base->set.x[pos_set_find(&base->set, id)] + (int32_t)dx * NET_DELTA_QUANT;
+        out->y[i] = base->set.y[pos_set_find(&base->set, id)] + (int32_t)dy * NET_DELTA_QUANT;
+    }
+    us->rx_seq = f->seq;
+    return 1;
+}
+
+// Datagram I/O: one frame per datagram, same header as on TCP.
+static inline int udp_send_frame(int fd, const NetFrame *f, const struct sockaddr *to, socklen_t tolen) {
+    unsigned char bytes[NET_HDR_LEN + NET_MAX_PAYLOAD];
+    size_t len = net_frame_bytes(f, bytes);
+    return (sendto(fd, bytes, len, MSG_DONTWAIT | MSG_NOSIGNAL, to, tolen) == (ssize_t)len) ? 0 : -1;
+}
+
+// Returns 1, 0 when there is nothing left to read, -1 for a datagram to ignore.
+static inline int udp_recv_frame(int fd, NetFrame *f, struct sockaddr_in *from) {
+    unsigned char bytes[NET_HDR_LEN + NET_MAX_PAYLOAD];
+    socklen_t fromlen = sizeof(*from);
+    ssize_t n = recvfrom(fd, bytes, sizeof(bytes), MSG_DONTWAIT, (struct sockaddr *)from, &fromlen);
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    if (n < NET_HDR_LEN) return -1;
+    f->version = bytes[0];
+    f->type = bytes[1];
+    f->len = net_get_u16(bytes + 2);
+    f->seq = net_get_u32(bytes + 4);
+    f->ack = net_get_u32(bytes + 8);
+    if (f->version != NET_PROTO_VERSION || f->len > NET_MAX_PAYLOAD || NET_HDR_LEN + (ssize_t)f->len != n) return -1;
+    memcpy(f->payload, bytes + NET_HDR_LEN, f->len);
+    return 1;
+}
+
+#endif
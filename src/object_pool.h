@@ -0,0 +1,309 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "blackboard.h"
+
+// Obstacle/target positions live in their own shared-memory object, sized at
+// startup from config.json ("max_objects") and grown by master when the
+// requested counts no longer fit. The blackboard only keeps the counts
+// (bb->objects[]) and the pool geometry (bb->pool).
+//
+// The pool is a sequence of fixed-size chunks, each one structure-of-arrays.
+// Growing only appends chunks, so an object never moves and a process that
+// still has the old (smaller) mapping keeps reading/writing valid memory until
+// it notices bb->pool.generation moved and remaps. Every array in a chunk has a
+// single owner (Obstacle, Target, Dynamics for the hit masks) and is a whole
+// number of cache lines, so owners never share lines.
+//
+// In front of the chunks sits a fixed-size header with one occupancy bitmap per
+// kind (bit y*occ_w + x set if an object of that kind sits on cell (x, y)),
+// written by the generator together with the positions. It never moves when
+// the pool grows. Dynamics uses it to test the drone cell in O(1).
+//
+// The engine build (BB_ENGINE) keeps the pool in an anonymous memfd instead of
+// a named segment; its fd sits in bb->pool and every component thread maps its
+// own view of it, so growing works exactly like between processes.
+#define POOL_SHM_NAME "/blackboard_objects"
+#define POOL_CHUNK 1024     // objects per kind per chunk
+#define POOL_OCC_BITS (1 << 19)     // per kind: a 1024x512 play area. Bigger ones publish no bitmap
+#define POOL_PLACE_TRIES 32         // generators: attempts to find a free cell before accepting a shared one
+
+typedef struct {
+    uint64_t occ[OBJ_KINDS][POOL_OCC_BITS / 64];
+} PoolHeader;
+
+typedef struct {
+    struct {
+        int xs[POOL_CHUNK];
+        int ys[POOL_CHUNK];
+    } pos[OBJ_KINDS];                           // [OBJ_OBSTACLES] Obstacle, [OBJ_TARGETS] Target
+    unsigned char hit[OBJ_KINDS][POOL_CHUNK];   // Dynamics
+} PoolChunk;
+
+// Process-local handle on the pool mapping.
+typedef struct {
+    int fd;
+    PoolHeader *header;
+    PoolChunk *chunks;
+    int n_chunks;
+    unsigned int generation;
+} ObjectPool;
+
+// Private, contiguous copy of one object kind (what Dynamics and Window work on).
+typedef struct {
+    unsigned int version;   // bb->objects[kind].seq the positions were copied at
+    unsigned int hit_for;   // objects version the hit mask refers to
+    int count;
+    int cap;
+    int *xs, *ys;
+    unsigned char *hit;
+    uint64_t *occ;          // occupancy bitmap copy, occ_w*occ_h bits (none if occ_w == 0)
+    int occ_w, occ_h, occ_cap;
+} ObjectList;
+
+static inline int occ_words(int w, int h) {
+    return (w * h + 63) / 64;
+}
+
+// 0 if (x, y) is outside the bitmap: the caller has to look the cell up another way.
+static inline int occ_covers(int w, int h, int x, int y) {
+    return x >= 0 && y >= 0 && x < w && y < h;
+}
+
+static inline int occ_test(const uint64_t *bits, int w, int x, int y) {
+    long b = (long)y * w + x;
+    return (bits[b >> 6] >> (b & 63)) & 1;
+}
+
+static inline void occ_set(uint64_t *bits, int w, int x, int y) {
+    long b = (long)y * w + x;
+    bits[b >> 6] |= (uint64_t)1 << (b & 63);
+}
+
+static inline int pool_capacity(const ObjectPool *p) {
+    return p->n_chunks * POOL_CHUNK;
+}
+
+static inline int pool_chunks_for(int objects) {
+    if (objects < 1) objects = 1;
+    return (objects + POOL_CHUNK - 1) / POOL_CHUNK;
+}
+
+static inline size_t pool_bytes(int n_chunks) {
+    return sizeof(PoolHeader) + sizeof(PoolChunk) * (size_t)n_chunks;
+}
+
+static inline int pool_map(ObjectPool *p, int n_chunks) {
+    void *base = mmap(NULL, pool_bytes(n_chunks), PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, 0);
+    if (base == MAP_FAILED) return -1;
+    if (p->header) munmap(p->header, pool_bytes(p->n_chunks));
+    p->header = base;
+    p->chunks = (PoolChunk *)((char *)base + sizeof(PoolHeader));
+    p->n_chunks = n_chunks;
+    return 0;
+}
+
+// master: create the pool and publish its geometry.
+static inline int pool_create(ObjectPool *p, newBlackboard *bb, int n_chunks) {
+    memset(p, 0, sizeof(*p));
+#ifdef BB_ENGINE
+    p->fd = (int)syscall(SYS_memfd_create, "blackboard_objects", 0);
+#else
+    p->fd = shm_open(POOL_SHM_NAME, O_CREAT | O_RDWR, 0666);
+#endif
+    if (p->fd == -1) return -1;
+    if (ftruncate(p->fd, pool_bytes(n_chunks)) == -1) return -1;
+    if (pool_map(p, n_chunks) == -1) return -1;
+    p->generation = 1;
+    BB_WRITE_BEGIN(&bb->pool);
+    bb->pool.generation = p->generation;
+    bb->pool.chunks = n_chunks;
+    bb->pool.fd = p->fd;
+    BB_WRITE_END(&bb->pool);
+    return 0;
+}
+
+// master: grow (never shrink) and bump the generation so everybody remaps.
+static inline int pool_grow(ObjectPool *p, newBlackboard *bb, int n_chunks) {
+    if (n_chunks <= p->n_chunks) return 0;
+    if (ftruncate(p->fd, pool_bytes(n_chunks)) == -1) return -1;
+    if (pool_map(p, n_chunks) == -1) return -1;
+    p->generation++;
+    BB_WRITE_BEGIN(&bb->pool);
+    bb->pool.generation = p->generation;
+    bb->pool.chunks = n_chunks;
+    BB_WRITE_END(&bb->pool);
+    return 0;
+}
+
+// Everybody else: remap if master resized the pool since we last looked.
+static inline int pool_sync(ObjectPool *p, const newBlackboard *bb) {
+    BBPool geo;
+    BB_READ(&bb->pool, geo);
+    if (geo.generation == p->generation && p->header) return 0;
+    if (pool_map(p, geo.chunks) == -1) return -1;
+    p->generation = geo.generation;
+    return 0;
+}
+
+static inline int pool_open(ObjectPool *p, const newBlackboard *bb) {
+    memset(p, 0, sizeof(*p));
+#ifdef BB_ENGINE
+    p->fd = dup(bb->pool.fd);
+#else
+    p->fd = shm_open(POOL_SHM_NAME, O_RDWR, 0666);
+#endif
+    if (p->fd == -1) return -1;
+    return pool_sync(p, bb);
+}
+
+static inline void pool_close(ObjectPool *p) {
+    if (p->header) munmap(p->header, pool_bytes(p->n_chunks));
+    if (p->fd >= 0) close(p->fd);
+    p->header = NULL;
+    p->chunks = NULL;
+    p->n_chunks = 0;
+}
+
+static inline int object_list_reserve(ObjectList *l, int n) {
+    if (n <= l->cap) return 0;
+    int *xs = realloc(l->xs, sizeof(int) * n);
+    if (xs) l->xs = xs;
+    int *ys = realloc(l->ys, sizeof(int) * n);
+    if (ys) l->ys = ys;
+    unsigned char *hit = realloc(l->hit, n);
+    if (hit) l->hit = hit;
+    if (!xs || !ys || !hit) return -1;
+    memset(l->hit + l->cap, 0, n - l->cap);
+    l->cap = n;
+    return 0;
+}
+
+static inline int object_list_reserve_occ(ObjectList *l, int w, int h) {
+    int words = occ_words(w, h);
+    if (words <= l->occ_cap) return 0;
+    uint64_t *occ = realloc(l->occ, sizeof(uint64_t) * words);
+    if (!occ) return -1;
+    l->occ = occ;
+    l->occ_cap = words;
+    return 0;
+}
+
+static inline void object_list_init(ObjectList *l) {
+    memset(l, 0, sizeof(*l));
+    l->version = ~0u;
+    l->hit_for = ~0u;
+}
+
+// Slot i is drawn/felt unless it is empty (-1) or Dynamics already consumed it.
+static inline int object_alive(const ObjectList *l, int i) {
+    if (l->xs[i] < 0) return 0;
+    return !(l->hit_for == l->version && l->hit[i]);
+}
+
+// Generators (and the network thread on a server): publish a new set of positions
+// and, if occ is not NULL, its occ_w x occ_h occupancy bitmap.
+static inline void pool_publish_objects(ObjectPool *p, newBlackboard *bb, int kind, const int *xs, const int *ys, int n,
+                                        const uint64_t *occ, int occ_w, int occ_h) {
+    if (n > pool_capacity(p)) n = pool_capacity(p);
+    if (!occ || occ_w * occ_h > POOL_OCC_BITS) occ_w = occ_h = 0;
+    BB_WRITE_BEGIN(&bb->objects[kind]);
+    if (occ_w > 0) memcpy(p->header->occ[kind], occ, sizeof(uint64_t) * occ_words(occ_w, occ_h));
+    bb->objects[kind].occ_w = occ_w;
+    bb->objects[kind].occ_h = occ_h;
+    for (int done = 0; done < n; done += POOL_CHUNK) {
+        int len = (n - done < POOL_CHUNK) ? n - done : POOL_CHUNK;
+        memcpy(p->chunks[done / POOL_CHUNK].pos[kind].xs, xs + done, sizeof(int) * len);
+        memcpy(p->chunks[done / POOL_CHUNK].pos[kind].ys, ys + done, sizeof(int) * len);
+    }
+    bb->objects[kind].count = n;
+    BB_WRITE_END(&bb->objects[kind]);
+}
+
+// Copy one kind out of the pool if its version moved. 1 copied, 0 unchanged
+// (or not readable yet: try again later), -1 error. out keeps its previous
+// set unless 1 is returned.
+static inline int pool_read_objects(ObjectPool *p, const newBlackboard *bb, int kind, ObjectList *out) {
+    const BBObjects *sec = &bb->objects[kind];
+    if (seq_version(&sec->seq) == out->version) return 0;
+    for (;;) {
+        unsigned int s = seq_read_begin(&sec->seq);
+        int n = sec->count;
+        int occ_w = sec->occ_w, occ_h = sec->occ_h;
+        if (n < 0) n = 0;
+        if (occ_w < 0 || occ_h < 0 || occ_w * occ_h > POOL_OCC_BITS) occ_w = occ_h = 0;   // torn read, retried below
+        if (n > pool_capacity(p)) {
+            // master grew the pool since our last look: remap and start over.
+            if (pool_sync(p, bb) == -1) return -1;
+            // Still too small: the count is ahead of the geometry we can see.
+            // Keep the old set, the next call looks again.
+            if (n > pool_capacity(p) && !seq_read_retry(&sec->seq, s)) return 0;
+            continue;
+        }
+        if (object_list_reserve(out, n) == -1) return -1;
+        if (object_list_reserve_occ(out, occ_w, occ_h) == -1) return -1;
+        if (occ_w > 0) memcpy(out->occ, p->header->occ[kind], sizeof(uint64_t) * occ_words(occ_w, occ_h));
+        out->occ_w = occ_w;
+        out->occ_h = occ_h;
+        for (int done = 0; done < n; done += POOL_CHUNK) {
+            int len = (n - done < POOL_CHUNK) ? n - done : POOL_CHUNK;
+            memcpy(out->xs + done, p->chunks[done / POOL_CHUNK].pos[kind].xs, sizeof(int) * len);
+            memcpy(out->ys + done, p->chunks[done / POOL_CHUNK].pos[kind].ys, sizeof(int) * len);
+        }
+        out->count = n;
+        if (!seq_read_retry(&sec->seq, s)) {
+            out->version = s;
+            return 1;
+        }
+    }
+}
+
+// Dynamics: publish the hit masks of both kinds.
+static inline void pool_publish_hits(ObjectPool *p, newBlackboard *bb, const ObjectList lists[OBJ_KINDS]) {
+    BB_WRITE_BEGIN(&bb->hits);
+    for (int kind = 0; kind < OBJ_KINDS; kind++) {
+        int n = lists[kind].count;
+        if (n > pool_capacity(p)) n = pool_capacity(p);
+        for (int done = 0; done < n; done += POOL_CHUNK) {
+            int len = (n - done < POOL_CHUNK) ? n - done : POOL_CHUNK;
+            memcpy(p->chunks[done / POOL_CHUNK].hit[kind], lists[kind].hit + done, len);
+        }
+        bb->hits.objects_seq[kind] = lists[kind].hit_for;
+        bb->hits.count[kind] = n;
+    }
+    BB_WRITE_END(&bb->hits);
+}
+
+// Readers: refresh the hit masks of lists already filled by pool_read_objects.
+// Reset *seen whenever a list got new positions, the masks must be re-read then.
+static inline int pool_read_hits(ObjectPool *p, const newBlackboard *bb, ObjectList lists[OBJ_KINDS], unsigned int *seen) {
+    if (seq_version(&bb->hits.seq) == *seen) return 0;
+    unsigned int s;
+    do {
+        s = seq_read_begin(&bb->hits.seq);
+        for (int kind = 0; kind < OBJ_KINDS; kind++) {
+            ObjectList *l = &lists[kind];
+            int n = bb->hits.count[kind];
+            if (n > l->count) n = l->count;     // masks for a bigger, newer set: ignored below anyway
+            if (n > pool_capacity(p)) n = pool_capacity(p);
+            if (n < 0) n = 0;
+            if (l->count > 0) memset(l->hit, 0, l->count);
+            for (int done = 0; done < n; done += POOL_CHUNK) {
+                int len = (n - done < POOL_CHUNK) ? n - done : POOL_CHUNK;
+                memcpy(l->hit + done, p->chunks[done / POOL_CHUNK].hit[kind], len);
+            }
+            l->hit_for = bb->hits.objects_seq[kind];
+        }
+    } while (seq_read_retry(&bb->hits.seq, s));
+    *seen = s;
+    return 1;
+}
+
+#endif
@@ -8,8 +8,10 @@
 #include <unistd.h>
 #include <time.h>
 #include "blackboard.h"
+#include "object_pool.h"
 
 
+#ifndef BB_ENGINE
 int main() {
     int shm_fd = shm_open(SHM_NAME, O_RDWR, 0666);
     if (shm_fd == -1) {
@@ -21,44 +23,93 @@ int main() {
         perror("mmap failed");
         return 1;
     }
-    sem_t *sem = sem_open(SEM_NAME, 0);
-    if (sem == SEM_FAILED) {
-        perror("sem_open failed");
+    int rc = obstacle_run(bb, NULL);
+    munmap(bb, sizeof(newBlackboard));
+    return rc;
+}
+#endif
+
+int obstacle_run(newBlackboard *bb, sem_t *sem) {
+    Heartbeat hb;
+    heartbeat_open(&hb, bb, WD_OBSTACLE);
+    logger("Obstacle process started. PID: %d", getpid());
+
+    ObjectPool pool;
+    if (pool_open(&pool, bb) == -1) {
+        perror("object pool open failed");
         return 1;
     }
-    int fd = open_watchdog_pipe(PIPE_OBSTACLE);
-    logger("Obstacle process started. PID: %d", getpid());
 
-    srand((unsigned int)time(NULL));
+    // Our own stream from the run's seed (rand() would be shared with the
+    // other threads of an engine run).
+    BBConfig cfg;
+    BB_READ(&bb->config, cfg);
+    uint64_t rng = cfg.seed ^ 0x6f62737461636c65ULL;
     int gen_x, gen_y;
+    // We are the only writer of this kind: build the new set privately and
+    // publish it in one short seqlock write, no semaphore involved.
+    int *xs = NULL, *ys = NULL, cap = 0;
+    uint64_t *occ = NULL;   // cells taken so far, published with the set for Dynamics' hit test
+    int occ_cap = 0;
+    BBWorld world;
+    BBDrone drone;
     while (1) {
-        sem_wait(sem);
-        for (int i=0; i<MAX_OBJECTS; i++){
-            bb->obstacle_xs[i] = -1;
-            bb->obstacle_ys[i] = -1;
+        BB_READ(&bb->config, cfg);
+        BB_READ(&bb->world, world);
+        BB_READ(&bb->drone, drone);
+        if (pool_sync(&pool, bb) == -1) {
+            perror("object pool remap failed");
+            break;
         }
-        for (int i=0; i<bb->n_obstacles; i++){ 
-            int play_w = bb_play_width(bb);
-            int play_h = bb_play_height(bb);
-            int max_x = (play_w > 3) ? (play_w - 2) : 1;
-            int max_y = (play_h > 3) ? (play_h - 2) : 1;
-
-            gen_x = (max_x > 1) ? (rand() % max_x + 1) : 1;
-            gen_y = (max_y > 1) ? (rand() % max_y + 1) : 1;
-            while (gen_x == bb->drone_x && gen_y == bb->drone_y){
-                gen_x = (max_x > 1) ? (rand() % max_x + 1) : 1;
-                gen_y = (max_y > 1) ? (rand() % max_y + 1) : 1;
+        int n = cfg.n_obstacles;
+        if (n < 0) n = 0;
+        if (n > pool_capacity(&pool)) n = pool_capacity(&pool);  // master grows the pool on its next config check
+        if (n > cap) {
+            int *nx = realloc(xs, sizeof(int) * n);
+            if (nx) xs = nx;
+            int *ny = realloc(ys, sizeof(int) * n);
+            if (ny) ys = ny;
+            if (!nx || !ny) {
+                perror("Obstacle buffer allocation failed");
+                break;
+            }
+            cap = n;
+        }
+        int play_w = bb_play_width(&world);
+        int play_h = bb_play_height(&world);
+        int max_x = (play_w > 3) ? (play_w - 2) : 1;
+        int max_y = (play_h > 3) ? (play_h - 2) : 1;
+        int use_occ = play_w * play_h <= POOL_OCC_BITS && occ_covers(play_w, play_h, max_x, max_y);
+        if (use_occ && occ_words(play_w, play_h) > occ_cap) {
+            uint64_t *no = realloc(occ, sizeof(uint64_t) * occ_words(play_w, play_h));
+            if (no) {
+                occ = no;
+                occ_cap = occ_words(play_w, play_h);
+            } else {
+                use_occ = 0;
             }
-            bb->obstacle_xs[i] = gen_x;
-            bb->obstacle_ys[i] = gen_y;
         }
-        sem_post(sem);
-        send_heartbeat(fd);
-        sleep(OBSTACLE_GENERATION_DELAY);
+        if (use_occ) memset(occ, 0, sizeof(uint64_t) * occ_words(play_w, play_h));
+        for (int i=0; i<n; i++){
+            // Never on the drone, and one object per cell unless the area is nearly full.
+            int tries = 0;
+            do {
+                gen_x = (max_x > 1) ? (int)(bb_rand(&rng) % max_x + 1) : 1;
+                gen_y = (max_y > 1) ? (int)(bb_rand(&rng) % max_y + 1) : 1;
+            } while ((gen_x == drone.drone_x && gen_y == drone.drone_y) ||
+                     (use_occ && ++tries < POOL_PLACE_TRIES && occ_test(occ, play_w, gen_x, gen_y)));
+            if (use_occ) occ_set(occ, play_w, gen_x, gen_y);
+            xs[i] = gen_x;
+            ys[i] = gen_y;
+        }
+        pool_publish_objects(&pool, bb, OBJ_OBSTACLES, xs, ys, n, use_occ ? occ : NULL, play_w, play_h);
+        heartbeat_sleep(&hb, OBSTACLE_GENERATION_DELAY * 1000000000LL);     // the watchdog knows we are idle meanwhile
     }
 
-    if (fd >= 0) { close(fd); }
-    sem_close(sem);
-    munmap(bb, sizeof(newBlackboard));
+    free(xs);
+    free(ys);
+    free(occ);
+    pool_close(&pool);
+    heartbeat_close(&hb);
     return 0;
 }
@@ -0,0 +1,154 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include <math.h>
+#include "blackboard.h"
+#include "object_pool.h"
+#include "force_kernel.h"
+
+// The drone's physics, shared by Dynamics (the live world) and batch (many
+// independent ones), so a world steps through the exact same arithmetic in
+// both. Everything here works on plain values: the callers decide whether the
+// state lives in a blackboard view or in batch's per-world arrays.
+
+// Private copy of the objects (positions + hit masks) and the force field over
+// them, rebuilt only when a set (or the world) changes.
+typedef struct {
+    ObjectList list[OBJ_KINDS];
+    ForceField field;
+} WorldObjects;
+
+// Hits found by the steps of one wake-up, logged once the drone is published.
+#define HIT_QUEUE_LEN 64
+typedef struct {
+    int kind;
+    int x, y;
+    double t;               // stats.time_elapsed at the hit
+} HitEvent;
+
+typedef struct {
+    HitEvent ev[HIT_QUEUE_LEN];
+    int n;
+    long dropped;
+} HitQueue;
+
+static inline double physics_score(const Stats *stats) {
+    return (double)stats->hit_targets        * 30.0 -
+           (double)stats->hit_obstacles      * 5.0 -
+           stats->time_elapsed               * 0.05 -
+           stats->distance_traveled          * 0.1;
+}
+
+// One implicit Euler step of m*x'' + c*x' = F along one axis. Plain scalars,
+// so a loop over many worlds vectorizes.
+static inline double physics_integrate(double mass, double damp, double F, double x_i, double x_i_minus_1) {
+    return (1/(mass+damp*DT)) * (F * DT * DT - mass * (x_i_minus_1-2*x_i) + damp * DT * x_i);
+}
+
+// Adds the wall repulsion to the obstacle sum already in *Fx/*Fy (from the
+// force kernel) and clamps the total. x/y are the drone cell.
+static inline void physics_wall_force(const Physix *ph, int x, int y, int play_w, int play_h, double *Fx, double *Fy) {
+    double repulsive;
+
+    if (x < ph->radius) {
+        repulsive = ph->obst_repl_coef * (1.0 / (x + EPSILON) - 1.0 / ph->radius) / (x * x + EPSILON);
+        *Fx += repulsive;
+    } // Left wall
+    if (play_w - x < ph->radius) {
+        repulsive = ph->obst_repl_coef * (1.0 / (play_w - x + EPSILON) - 1.0 / ph->radius) / ((play_w - x) * (play_w - x) + EPSILON);
+        *Fx -= repulsive;
+    } // Right wall
+    if (y < ph->radius) {
+        repulsive = ph->obst_repl_coef * (1.0 / (y + EPSILON) - 1.0 / ph->radius) / (y * y + EPSILON);
+        *Fy += repulsive;
+    } // Top wall
+    if (play_h - y < ph->radius) {
+        repulsive = ph->obst_repl_coef * (1.0 / (play_h - y + EPSILON) - 1.0 / ph->radius) / ((play_h - y) * (play_h - y) + EPSILON);
+        *Fy -= repulsive;
+    } // Bottom wall
+
+    // Limit the repulsion force to a maximum of 100  // TODO PARAMETER
+    if (*Fx > 100){ *Fx = 100;}
+    if (*Fy > 100){ *Fy = 100;}
+    if (*Fx < -100){ *Fx = -100;}
+    if (*Fy < -100){ *Fy = -100;}
+}
+
+// Total force on a drone on cell (x, y) with command force *Fx/*Fy. Objects
+// and walls only act while the simulation runs.
+static inline void physics_force(const ForceField *field, const Physix *ph, int x, int y, int play_w, int play_h,
+                                 int running, double *Fx, double *Fy) {
+    double repulsive_Fx = 0.0, repulsive_Fy = 0.0, attractive_Fx = 0.0, attractive_Fy = 0.0;
+    if (running) {
+        ForceSums obj;
+        force_field_eval(field, x, y, ph, &obj);
+        repulsive_Fx = obj.rep_x;
+        repulsive_Fy = obj.rep_y;
+        physics_wall_force(ph, x, y, play_w, play_h, &repulsive_Fx, &repulsive_Fy);
+        attractive_Fx = obj.att_x;
+        attractive_Fy = obj.att_y;
+    }
+    *Fx += repulsive_Fx + attractive_Fx;
+    *Fy += repulsive_Fy + attractive_Fy;
+}
+
+// Keeps the drone cell inside [1, limit-1) along one axis; a drone put back
+// loses its speed.
+static inline void physics_bounds(int *cell, double *p_i, double *p_i_minus_1, int limit) {
+    if (*cell < 1) {
+        *cell = 1;
+        *p_i = *p_i_minus_1 = *cell;
+    }
+    if (*cell > limit-1) {
+        *cell = limit-2;
+        *p_i = *p_i_minus_1 = *cell;
+    }
+}
+
+// Collisions with the drone cell: marks the objects there as hit and counts
+// them in stats. The generators' occupancy bitmaps answer the common "nothing
+// here" case with one bit test per kind; only on a set bit (or when the
+// publisher had no bitmap, e.g. the remote obstacle) the objects on that cell
+// are looked up through the force field's grid cell. hq may be NULL.
+static inline int physics_hits(WorldObjects *objs, int x, int y, Stats *stats, HitQueue *hq) {
+    int maybe = 0;
+    for (int kind = 0; kind < OBJ_KINDS; kind++) {
+        const ObjectList *l = &objs->list[kind];
+        if (l->count == 0) continue;
+        if (occ_covers(l->occ_w, l->occ_h, x, y) && !occ_test(l->occ, l->occ_w, x, y)) continue;
+        maybe = 1;
+    }
+    const SpatialGrid *g = &objs->field.grid;
+    if (!maybe || g->count == 0 || x < 0 || y < 0 || x >= g->play_w || y >= g->play_h) return 0;
+
+    int hits = 0;
+    int c = grid_cell_of(g, x, y);
+    for (int j = g->cell_start[c]; j < g->cell_start[c + 1]; j++) {
+        if (g->xs[j] != x || g->ys[j] != y) continue;
+        int kind;
+        int i = force_field_object(&objs->field, j, &kind);
+        ObjectList *l = &objs->list[kind];
+        if (!object_alive(l, i)) continue;
+        l->hit[i] = 1;
+        if (kind == OBJ_OBSTACLES) {
+            stats->hit_obstacles += 1;
+        } else {
+            stats->hit_targets += 1;
+        }
+        if (hq && hq->n < HIT_QUEUE_LEN) {
+            hq->ev[hq->n++] = (HitEvent){ kind, x, y, stats->time_elapsed };
+        } else if (hq) {
+            hq->dropped++;
+        }
+        hits++;
+    }
+    return hits;
+}
+
+// Distance covered by the last step, 0 for a drone that didn't move.
+static inline double physics_moved(double x_i, double x_i_minus_1, double y_i, double y_i_minus_1) {
+    if (x_i == x_i_minus_1 && y_i == y_i_minus_1) return 0.0;
+    return sqrt((x_i - x_i_minus_1) * (x_i - x_i_minus_1) + (y_i - y_i_minus_1) * (y_i - y_i_minus_1));
+}
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "blackboard.h"
+#include "object_pool.h"
+
+// Session recordings (master --record / BB_RECORD) and their replay (master
+// --replay / BB_REPLAY). Dynamics records everything its steps depend on, tagged
+// with the step it came in before:
+//   - the config, world and input sections, whenever they change (and the
+//     keyboard commands behind an input change, for reading);
+//   - every object set it picks up;
+//   - the drone it started from;
+//   - per step, the drone cell and a checksum of the exact state after it.
+// A replay feeds the same things to the same steps, unpaced, and compares
+// every checksum: it either reproduces the run bit for bit or says at which
+// step it stopped doing so.
+//
+// The file is mapped and grows REC_GROW at a time. A record's tag is written
+// after its payload, so a Dynamics killed mid-run (master's SIGTERM, or the
+// engine exiting on a quit) still leaves every step before it readable; the
+// file keeps its mapped size then, the rest is zeros (a hole on disk). Records are native structs: a
+// recording replays on the build that wrote it (the header checks the layout).
+#define REC_MAGIC "BBREC02"
+#define REC_GROW (16 << 20)
+
+enum { REC_NONE, REC_CONFIG, REC_WORLD, REC_INPUT, REC_COMMAND, REC_DRONE, REC_OBJECTS, REC_STEPS };
+
+typedef struct {
+    char magic[8];
+    uint32_t header_size;
+    uint16_t config_size, world_size, input_size, drone_size;
+    int32_t par_min;        // force sums chunked from this many slots: it changes their rounding
+    uint64_t seed;          // the generators' seed (config.seed)
+    double dt;
+    int64_t started;        // wall clock, seconds
+} RecHeader;
+
+typedef struct {
+    uint32_t type;          // REC_NONE: the recording ends here
+    uint32_t len;           // payload bytes after the tag, a multiple of 8
+    int64_t step;           // applies before this step (REC_STEPS: its first step)
+} RecTag;
+
+typedef struct {            // REC_OBJECTS payload, then int32 xs[count], ys[count]
+    int32_t kind;
+    uint32_t version;
+    int32_t count;
+    int32_t pad;
+} RecObjects;
+
+typedef struct {            // one per step in a REC_STEPS run
+    int16_t x, y;           // drone cell after the step
+    uint32_t check;         // rec_hash() of the exact state after the step
+} RecStep;
+
+// FNV-1a, for the per-step checksums.
+static inline uint64_t rec_hash(uint64_t h, const void *p, size_t n) {
+    const unsigned char *b = p;
+    for (size_t i = 0; i < n; i++) h = (h ^ b[i]) * 0x100000001b3ULL;
+    return h;
+}
+#define REC_HASH_SEED 0xcbf29ce484222325ULL
+
+static inline size_t rec_pad(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// ---- writing ----
+
+typedef struct {
+    int fd;
+    char *map;              // NULL: not recording (never started, or gave up)
+    size_t cap, len;
+    size_t run;             // offset of the open REC_STEPS tag, 0 if there is none
+    int64_t run_next;       // the step that run goes on with
+} Recorder;
+
+// Stops recording and leaves the file at what was written so far.
+static inline void rec_close(Recorder *r) {
+    if (!r->map) return;
+    munmap(r->map, r->cap);
+    if (ftruncate(r->fd, r->len) == -1) perror("recording truncate failed");
+    close(r->fd);
+    r->map = NULL;
+}
+
+// Room for n more bytes (plus the zero tag that ends the file). On failure
+// the recording is closed where it is: the run goes on without it.
+static inline int rec_reserve(Recorder *r, size_t n) {
+    if (!r->map) return -1;
+    if (r->len + n + sizeof(RecTag) <= r->cap) return 0;
+    size_t cap = r->cap;
+    while (r->len + n + sizeof(RecTag) > cap) cap += REC_GROW;
+    char *map = MAP_FAILED;
+    if (ftruncate(r->fd, cap) == 0) map = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("recording grow failed");
+        rec_close(r);
+        return -1;
+    }
+    munmap(r->map, r->cap);
+    r->map = map;
+    r->cap = cap;
+    return 0;
+}
+
+// Returns 0, or -1 (already reported) if the file can't be had.
+static inline int rec_open(Recorder *r, const char *path, uint64_t seed, int par_min) {
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (r->fd == -1) {
+        perror("recording open failed");
+        return -1;
+    }
+    if (ftruncate(r->fd, REC_GROW) == -1) {
+        perror("recording truncate failed");
+        close(r->fd);
+        return -1;
+    }
+    r->map = mmap(NULL, REC_GROW, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (r->map == MAP_FAILED) {
+        perror("recording mmap failed");
+        r->map = NULL;
+        close(r->fd);
+        return -1;
+    }
+    r->cap = REC_GROW;
+    RecHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, REC_MAGIC, sizeof(h.magic));
+    h.header_size = sizeof(RecHeader);
+    h.config_size = sizeof(BBConfig);
+    h.world_size = sizeof(BBWorld);
+    h.input_size = sizeof(BBInput);
+    h.drone_size = sizeof(BBDrone);
+    h.par_min = par_min;
+    h.seed = seed;
+    h.dt = DT;
+    h.started = time(NULL);
+    memcpy(r->map, &h, sizeof(h));
+    r->len = rec_pad(sizeof(h));
+    return 0;
+}
+
+// Payload area of a record of n bytes; fill it, then rec_commit() it.
+static inline void *rec_begin(Recorder *r, size_t n) {
+    if (rec_reserve(r, sizeof(RecTag) + rec_pad(n)) == -1) return NULL;
+    r->run = 0;     // whatever comes next starts a new run of steps
+    return r->map + r->len + sizeof(RecTag);
+}
+
+static inline void rec_commit(Recorder *r, uint32_t type, int64_t step, size_t n) {
+    RecTag *t = (RecTag *)(r->map + r->len);
+    t->len = rec_pad(n);
+    t->step = step;
+    __atomic_store_n(&t->type, type, __ATOMIC_RELEASE);     // last: the record is whole
+    r->len += sizeof(RecTag) + rec_pad(n);
+}
+
+static inline void rec_event(Recorder *r, uint32_t type, int64_t step, const void *p, size_t n) {
+    void *dst = rec_begin(r, n);
+    if (!dst) return;
+    memcpy(dst, p, n);
+    rec_commit(r, type, step, n);
+}
+
+static inline void rec_objects(Recorder *r, int64_t step, int kind, const ObjectList *l) {
+    size_t n = sizeof(RecObjects) + 2 * sizeof(int32_t) * l->count;
+    RecObjects *o = rec_begin(r, n);
+    if (!o) return;
+    o->kind = kind;
+    o->version = l->version;
+    o->count = l->count;
+    o->pad = 0;
+    int32_t *xs = (int32_t *)(o + 1);
+    memcpy(xs, l->xs, sizeof(int32_t) * l->count);
+    memcpy(xs + l->count, l->ys, sizeof(int32_t) * l->count);
+    rec_commit(r, REC_OBJECTS, step, n);
+}
+
+// Appends a step to the open run, or opens a new one (after an event, or
+// when steps were skipped).
+static inline void rec_step(Recorder *r, int64_t step, int x, int y, uint32_t check) {
+    if (!r->run || r->run_next != step) {
+        if (rec_reserve(r, sizeof(RecTag) + sizeof(RecStep)) == -1) return;
+        rec_commit(r, REC_STEPS, step, 0);
+        r->run = r->len - sizeof(RecTag);
+        r->run_next = step;
+    }
+    if (rec_reserve(r, sizeof(RecStep)) == -1) return;
+    RecStep *s = (RecStep *)(r->map + r->len);
+    s->x = (int16_t)x;
+    s->y = (int16_t)y;
+    s->check = check;
+    r->len += sizeof(RecStep);
+    RecTag *t = (RecTag *)(r->map + r->run);
+    __atomic_store_n(&t->len, t->len + (uint32_t)sizeof(RecStep), __ATOMIC_RELEASE);
+    r->run_next++;
+}
+
+// ---- reading ----
+
+typedef struct {
+    const char *map;
+    size_t len, pos;
+    RecHeader hdr;
+} RecReader;
+
+// Returns 0, or -1 (already reported) if the file isn't a recording this build can replay.
+static inline int rec_read_open(RecReader *rd, const char *path) {
+    memset(rd, 0, sizeof(*rd));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("recording open failed");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(RecHeader)) {
+        fprintf(stderr, "recording %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+    const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("recording mmap failed");
+        return -1;
+    }
+    memcpy(&rd->hdr, map, sizeof(rd->hdr));
+    const RecHeader *h = &rd->hdr;
+    if (memcmp(h->magic, REC_MAGIC, sizeof(h->magic)) != 0 || h->header_size != sizeof(RecHeader) ||
+        h->config_size != sizeof(BBConfig) || h->world_size != sizeof(BBWorld) ||
+        h->input_size != sizeof(BBInput) || h->drone_size != sizeof(BBDrone) || h->dt != DT) {
+        fprintf(stderr, "recording %s was not written by this build\n", path);
+        munmap((void *)map, st.st_size);
+        return -1;
+    }
+    rd->map = map;
+    rd->len = st.st_size;
+    rd->pos = rec_pad(sizeof(RecHeader));
+    return 0;
+}
+
+// The next record (its payload follows the tag), NULL at the end.
+static inline const RecTag *rec_next(RecReader *rd) {
+    if (rd->pos + sizeof(RecTag) > rd->len) return NULL;
+    const RecTag *t = (const RecTag *)(rd->map + rd->pos);
+    if (t->type == REC_NONE || t->len > rd->len - rd->pos - sizeof(RecTag)) return NULL;
+    rd->pos += sizeof(RecTag) + t->len;
+    return t;
+}
+
+static inline void rec_read_close(RecReader *rd) {
+    if (rd->map) munmap((void *)rd->map, rd->len);
+    rd->map = NULL;
+}
+
+#endif
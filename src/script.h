@@ -0,0 +1,122 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "blackboard.h"
+
+// Input scripts for headless runs (Dynamics with BB_SCRIPT) and batch: one
+// command per line at a simulated time in seconds:
+//   <t> start | pause | force FX FY | reset | end
+// Commands are applied to a private copy of the input section at the step
+// they fall on, so a run doesn't depend on how fast it goes. "end" stops it.
+enum { SCRIPT_START, SCRIPT_PAUSE, SCRIPT_FORCE, SCRIPT_RESET, SCRIPT_END };
+
+typedef struct {
+    long step;
+    int cmd;
+    int fx, fy;
+} ScriptCmd;
+
+typedef struct {
+    ScriptCmd *cmds;        // sorted by step
+    int n, next;            // next: the player's cursor (copy the struct to replay it again)
+    long end_step;
+} Script;
+
+// Returns 0, or -1 (already reported) if the script can't be used.
+static inline int script_load(const char *path, Script *sc) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("script open failed");
+        return -1;
+    }
+    char line[256], name[32];
+    int cap = 0, lineno = 0, has_end = 0;
+    memset(sc, 0, sizeof(*sc));
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        double t;
+        ScriptCmd c = {0};
+        int got = sscanf(line, "%lf %31s %d %d", &t, name, &c.fx, &c.fy);
+        if (got <= 0 || line[strspn(line, " \t")] == '#') continue;    // blank or comment
+        if (got < 2 || t < 0) goto bad;
+        c.step = lround(t / DT);
+        if (strcmp(name, "start") == 0)       c.cmd = SCRIPT_START;
+        else if (strcmp(name, "pause") == 0)  c.cmd = SCRIPT_PAUSE;
+        else if (strcmp(name, "reset") == 0)  c.cmd = SCRIPT_RESET;
+        else if (strcmp(name, "end") == 0)    c.cmd = SCRIPT_END;
+        else if (strcmp(name, "force") == 0 && got == 4) c.cmd = SCRIPT_FORCE;
+        else goto bad;
+        if (c.cmd == SCRIPT_END && (!has_end || c.step < sc->end_step)) {
+            sc->end_step = c.step;
+            has_end = 1;
+        }
+        if (sc->n == cap) {
+            int ncap = cap ? cap * 2 : 64;
+            ScriptCmd *nc = realloc(sc->cmds, sizeof(ScriptCmd) * ncap);
+            if (!nc) {
+                perror("script allocation failed");
+                fclose(f);
+                return -1;
+            }
+            sc->cmds = nc;
+            cap = ncap;
+        }
+        sc->cmds[sc->n++] = c;
+    }
+    fclose(f);
+    if (!has_end) {
+        fprintf(stderr, "script %s has no \"end\" command\n", path);
+        free(sc->cmds);
+        sc->cmds = NULL;
+        return -1;
+    }
+    // Insertion sort: scripts are usually in order already, and commands on
+    // the same step must keep the order they were written in.
+    for (int i = 1; i < sc->n; i++) {
+        ScriptCmd c = sc->cmds[i];
+        int j = i;
+        for (; j > 0 && sc->cmds[j - 1].step > c.step; j--) sc->cmds[j] = sc->cmds[j - 1];
+        sc->cmds[j] = c;
+    }
+    return 0;
+bad:
+    fprintf(stderr, "script %s line %d: can't parse \"%.*s\"\n", path, lineno, (int)strcspn(line, "\n"), line);
+    fclose(f);
+    free(sc->cmds);
+    sc->cmds = NULL;
+    return -1;
+}
+
+// Applies the commands due at this step, like Keyboard would. Returns 1 once
+// the run is over.
+static inline int script_apply(Script *sc, long step, BBInput *in) {
+    if (step >= sc->end_step) return 1;
+    while (sc->next < sc->n && sc->cmds[sc->next].step <= step) {
+        const ScriptCmd *c = &sc->cmds[sc->next++];
+        switch (c->cmd) {
+        case SCRIPT_START:
+            in->state = 1;
+            break;
+        case SCRIPT_PAUSE:
+            in->state = 0;
+            break;
+        case SCRIPT_FORCE:
+            in->command_force_x = c->fx;
+            in->command_force_y = c->fy;
+            break;
+        case SCRIPT_RESET:      // same as Keyboard's reset_game()
+            in->state = 0;
+            in->command_force_x = 0;
+            in->command_force_y = 0;
+            in->reset_epoch++;
+            break;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Uniform grid over the play area, used by Dynamics to find the obstacles and
+// targets close to the drone without scanning all of them every step.
+// Cells are `cell` wide (the force radius), so everything that can act on the
+// drone lives in the 3x3 block of cells around it.
+//
+// Layout is CSR-like: objects are counting-sorted by cell, cell c owns the slots
+// [cell_start[c], cell_start[c+1]). Coordinates are copied next to the index so
+// a query walks contiguous memory instead of jumping around the source arrays.
+// Cells are row-major, so the cells of one grid row that a query touches are a
+// single contiguous slot range. xs/ys are padded to a multiple of GRID_PAD
+// slots (zeros) so vector code can load whole blocks past the last object.
+#define GRID_PAD 4
+
+static inline int grid_padded(int n) {
+    return (n + GRID_PAD - 1) / GRID_PAD * GRID_PAD;
+}
+typedef struct {
+    double cell;
+    int cols, rows;
+    int *cell_start;        // cols*rows + 1 entries
+    int *idx;               // original object index for every slot
+    double *xs, *ys;        // coordinates, sorted by cell
+    int count;              // objects actually stored
+    int cap_cells, cap_items;
+
+    // What the grid was built from, so the owner knows when to rebuild.
+    unsigned int version;
+    int play_w, play_h;
+} SpatialGrid;
+
+static inline void grid_init(SpatialGrid *g) {
+    memset(g, 0, sizeof(*g));
+    g->version = ~0u;
+}
+
+static inline void grid_free(SpatialGrid *g) {
+    free(g->cell_start);
+    free(g->idx);
+    free(g->xs);
+    free(g->ys);
+    grid_init(g);
+}
+
+static inline int grid_stale(const SpatialGrid *g, unsigned int version, int play_w, int play_h, double radius) {
+    double cell = (radius > 1.0) ? radius : 1.0;
+    return g->version != version || g->play_w != play_w || g->play_h != play_h || g->cell != cell;
+}
+
+static inline int grid_cell_of(const SpatialGrid *g, int x, int y) {
+    return (int)(y / g->cell) * g->cols + (int)(x / g->cell);
+}
+
+// (Re)build from a source array. Objects outside [1, play_w) x [1, play_h) are
+// skipped, the same filter the force loops always applied. Returns -1 on OOM.
+static inline int grid_build(SpatialGrid *g, const int *xs, const int *ys, int n,
+                             int play_w, int play_h, double radius, unsigned int version) {
+    g->cell = (radius > 1.0) ? radius : 1.0;
+    g->cols = (play_w > 0) ? (int)(play_w / g->cell) + 1 : 1;
+    g->rows = (play_h > 0) ? (int)(play_h / g->cell) + 1 : 1;
+    g->play_w = play_w;
+    g->play_h = play_h;
+    g->version = version;
+
+    int cells = g->cols * g->rows;
+    if (cells + 1 > g->cap_cells) {
+        int *cs = realloc(g->cell_start, sizeof(int) * (cells + 1));
+        if (!cs) return -1;
+        g->cell_start = cs;
+        g->cap_cells = cells + 1;
+    }
+    if (grid_padded(n) > g->cap_items || !g->xs) {
+        int cap = grid_padded(n) > GRID_PAD ? grid_padded(n) : GRID_PAD;
+        int *idx = realloc(g->idx, sizeof(int) * cap);
+        double *gx = realloc(g->xs, sizeof(double) * cap);
+        double *gy = realloc(g->ys, sizeof(double) * cap);
+        if (idx) g->idx = idx;
+        if (gx) g->xs = gx;
+        if (gy) g->ys = gy;
+        if (!idx || !gx || !gy) return -1;
+        g->cap_items = cap;
+    }
+
+    // Counting sort: histogram, exclusive prefix sum, scatter.
+    memset(g->cell_start, 0, sizeof(int) * (cells + 1));
+    for (int i = 0; i < n; i++) {
+        if (xs[i] < 1 || ys[i] < 1 || xs[i] >= play_w || ys[i] >= play_h) continue;
+        g->cell_start[grid_cell_of(g, xs[i], ys[i]) + 1]++;
+    }
+    for (int c = 0; c < cells; c++) {
+        g->cell_start[c + 1] += g->cell_start[c];
+    }
+    g->count = g->cell_start[cells];
+    for (int i = 0; i < n; i++) {
+        if (xs[i] < 1 || ys[i] < 1 || xs[i] >= play_w || ys[i] >= play_h) continue;
+        int c = grid_cell_of(g, xs[i], ys[i]);
+        int slot = g->cell_start[c]++;      // temporarily used as a write cursor
+        g->idx[slot] = i;
+        g->xs[slot] = xs[i];
+        g->ys[slot] = ys[i];
+    }
+    // The cursors ended at the start of the next cell: shift back by one.
+    for (int c = cells; c > 0; c--) {
+        g->cell_start[c] = g->cell_start[c - 1];
+    }
+    g->cell_start[0] = 0;
+    for (int j = g->count; j < grid_padded(g->count); j++) {
+        g->idx[j] = -1;
+        g->xs[j] = 0;
+        g->ys[j] = 0;
+    }
+    return 0;
+}
+
+// Range of cells that can hold objects within `radius` of (x, y).
+static inline void grid_query_range(const SpatialGrid *g, double x, double y, double radius,
+                                    int *cx0, int *cy0, int *cx1, int *cy1) {
+    *cx0 = (int)floor((x - radius) / g->cell);
+    *cy0 = (int)floor((y - radius) / g->cell);
+    *cx1 = (int)floor((x + radius) / g->cell);
+    *cy1 = (int)floor((y + radius) / g->cell);
+    if (*cx0 < 0) *cx0 = 0;
+    if (*cy0 < 0) *cy0 = 0;
+    if (*cx1 >= g->cols) *cx1 = g->cols - 1;
+    if (*cy1 >= g->rows) *cy1 = g->rows - 1;
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <pthread.h>
+
+// Work-stealing task pool. task_pool_run(pool, n, fn, arg) calls fn(arg, i)
+// for every i in [0, n) across the pool's threads and returns once all of
+// them are done; the calling thread works too.
+//
+// Every thread has its own deque (0 is the caller's). A run deals its tasks
+// round-robin over the deques; a thread pops its own newest task first and,
+// when it has none left, steals the oldest one of another thread, so uneven
+// tasks even out without a central queue everybody fights over. Deques are
+// guarded by tiny spin locks: a task is the unit of work, never a single
+// object. Idle workers spin for a moment (a 1 kHz caller posts again soon)
+// and then sleep until the next run.
+//
+// One caller at a time, and tasks must not start runs of their own.
+#define TASK_SPIN 20000     // empty polls before an idle worker goes to sleep
+
+typedef void (*task_fn)(void *arg, int i);
+
+typedef struct {
+    task_fn fn;
+    void *arg;
+    int i;
+    int *pending;           // tasks of that run not done yet
+} Task;
+
+typedef struct {
+    alignas(64) int lock;
+    unsigned int head, tail;    // thieves take at head, the owner at tail
+    unsigned int cap;           // power of two
+    Task *ring;
+} TaskDeque;
+
+struct TaskPool;
+typedef struct {
+    struct TaskPool *pool;
+    int id;
+} TaskWorker;
+
+typedef struct TaskPool {
+    int n;                  // threads, the caller included
+    TaskDeque *q;
+    TaskWorker *workers;
+    pthread_t *th;
+    int stop;
+    unsigned int posted;    // bumped by every run
+    int sleepers;
+    pthread_mutex_t m;
+    pthread_cond_t cv;
+} TaskPool;
+
+static inline void task_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline void task_lock(TaskDeque *d) {
+    while (__atomic_exchange_n(&d->lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&d->lock, __ATOMIC_RELAXED)) task_relax();
+    }
+}
+
+static inline void task_unlock(TaskDeque *d) {
+    __atomic_store_n(&d->lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline int task_push(TaskDeque *d, Task t) {
+    task_lock(d);
+    if (d->tail - d->head == d->cap) {
+        unsigned int cap = d->cap ? d->cap * 2 : 64;
+        Task *ring = malloc(sizeof(Task) * cap);
+        if (!ring) {
+            task_unlock(d);
+            return -1;
+        }
+        for (unsigned int k = 0; k < d->tail - d->head; k++) ring[k] = d->ring[(d->head + k) & (d->cap - 1)];
+        free(d->ring);
+        d->ring = ring;
+        d->tail -= d->head;
+        d->head = 0;
+        d->cap = cap;
+    }
+    d->ring[d->tail & (d->cap - 1)] = t;
+    __atomic_store_n(&d->tail, d->tail + 1, __ATOMIC_RELEASE);
+    task_unlock(d);
+    return 0;
+}
+
+// Owner side (newest first, steal = 0) or thief side (oldest first).
+static inline int task_take(TaskDeque *d, Task *t, int steal) {
+    if (__atomic_load_n(&d->tail, __ATOMIC_ACQUIRE) == __atomic_load_n(&d->head, __ATOMIC_ACQUIRE)) return 0;
+    int got = 0;
+    task_lock(d);
+    if (d->tail != d->head) {
+        if (steal) {
+            *t = d->ring[d->head & (d->cap - 1)];
+            __atomic_store_n(&d->head, d->head + 1, __ATOMIC_RELEASE);
+        } else {
+            *t = d->ring[(d->tail - 1) & (d->cap - 1)];
+            __atomic_store_n(&d->tail, d->tail - 1, __ATOMIC_RELEASE);
+        }
+        got = 1;
+    }
+    task_unlock(d);
+    return got;
+}
+
+// Runs one task for thread `self`: its own first, else a stolen one.
+static inline int task_pool_one(TaskPool *p, int self) {
+    Task t;
+    int got = task_take(&p->q[self], &t, 0);
+    for (int k = 1; !got && k < p->n; k++) got = task_take(&p->q[(self + k) % p->n], &t, 1);
+    if (!got) return 0;
+    t.fn(t.arg, t.i);
+    __atomic_sub_fetch(t.pending, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void *task_worker_main(void *arg) {
+    TaskWorker *w = arg;
+    TaskPool *p = w->pool;
+    unsigned int seen = __atomic_load_n(&p->posted, __ATOMIC_ACQUIRE);
+    int idle = 0;
+    while (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+        if (task_pool_one(p, w->id)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < TASK_SPIN) {
+            task_relax();
+            continue;
+        }
+        pthread_mutex_lock(&p->m);
+        p->sleepers++;
+        while (p->posted == seen && !p->stop) pthread_cond_wait(&p->cv, &p->m);
+        p->sleepers--;
+        seen = p->posted;
+        pthread_mutex_unlock(&p->m);
+        idle = 0;
+    }
+    return NULL;
+}
+
+static inline void task_pool_destroy(TaskPool *p) {
+    pthread_mutex_lock(&p->m);
+    __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&p->cv);
+    pthread_mutex_unlock(&p->m);
+    // Also tears down a half-made pool (task_pool_create failing): any of
+    // the arrays may be missing then.
+    for (int k = 1; p->th && k < p->n; k++) {
+        if (p->th[k]) pthread_join(p->th[k], NULL);
+    }
+    for (int k = 0; p->q && k < p->n; k++) free(p->q[k].ring);
+    free(p->q);
+    free(p->workers);
+    free(p->th);
+    pthread_mutex_destroy(&p->m);
+    pthread_cond_destroy(&p->cv);
+    memset(p, 0, sizeof(*p));
+}
+
+// threads counts the caller: 1 runs everything on the caller. Returns -1 on failure.
+static inline int task_pool_create(TaskPool *p, int threads) {
+    memset(p, 0, sizeof(*p));
+    p->n = (threads > 1) ? threads : 1;
+    pthread_mutex_init(&p->m, NULL);
+    pthread_cond_init(&p->cv, NULL);
+    p->q = calloc(p->n, sizeof(TaskDeque));
+    p->workers = calloc(p->n, sizeof(TaskWorker));
+    p->th = calloc(p->n, sizeof(pthread_t));
+    if (!p->q || !p->workers || !p->th) {
+        task_pool_destroy(p);
+        return -1;
+    }
+    for (int k = 1; k < p->n; k++) {
+        p->workers[k] = (TaskWorker){ p, k };
+        if (pthread_create(&p->th[k], NULL, task_worker_main, &p->workers[k]) != 0) {
+            p->th[k] = 0;
+            task_pool_destroy(p);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline void task_pool_run(TaskPool *p, int n, task_fn fn, void *arg) {
+    int pending = n;
+    for (int i = 0; i < n; i++) {
+        Task t = { fn, arg, i, &pending };
+        if (task_push(&p->q[i % p->n], t) == -1) {    // no room: do it now
+            fn(arg, i);
+            __atomic_sub_fetch(&pending, 1, __ATOMIC_RELEASE);
+        }
+    }
+    if (p->n > 1) {
+        pthread_mutex_lock(&p->m);
+        p->posted++;
+        if (p->sleepers) pthread_cond_broadcast(&p->cv);
+        pthread_mutex_unlock(&p->m);
+    }
+    while (__atomic_load_n(&pending, __ATOMIC_ACQUIRE) > 0) {
+        if (!task_pool_one(p, 0)) task_relax();
+    }
+}
+
+#endif
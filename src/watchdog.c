@@ -2,7 +2,7 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/select.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <string.h>
@@ -11,75 +11,134 @@
 
 
 typedef struct {
-    const char *pipe_name;
-    int fd;
-    time_t last_heartbeat;
+    const char *name;
+    int deadline_ms;
+    int pid;                        // last sampled from the slot
+    unsigned long long iterations;  // last sampled from the slot
+    long long last_progress;        // monotonic ns, our watch start until the first iteration
+    long long idle_until;
 } ComponentMonitor;
 
+// A component is late once its deadline passed since its last iteration (or
+// since the end of an announced sleep). Before the first iteration it also
+// gets WD_STARTUP_GRACE_MS to boot. Closed slots are never late.
+static long long expiry_of(const ComponentMonitor *c) {
+    if (c->pid < 0) return -1;
+    long long allowed = (long long)c->deadline_ms * 1000000LL;
+    if (c->iterations == 0 && allowed < WD_STARTUP_GRACE_MS * 1000000LL) allowed = WD_STARTUP_GRACE_MS * 1000000LL;
+    long long from = (c->idle_until > c->last_progress) ? c->idle_until : c->last_progress;
+    return from + allowed;
+}
 
-int main() {  // watchdog works and receives signals neglecting the state machine of the whole process. others have been implemented to send heartbeats whatever the state is. 
+static void sample(const newBlackboard *bb, ComponentMonitor *c, int i) {
+    const BBHeartbeat *slot = &bb->heartbeat[i];
+    // last_progress_ns is stored last by heartbeat_tick(): acquire it first.
+    long long t = __atomic_load_n(&slot->last_progress_ns, __ATOMIC_ACQUIRE);
+    unsigned long long it = __atomic_load_n(&slot->iterations, __ATOMIC_RELAXED);
+    c->idle_until = __atomic_load_n(&slot->idle_until_ns, __ATOMIC_ACQUIRE);
+    c->pid = __atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE);
+    if (it != c->iterations) {
+        if (c->iterations == 0) {
+            logger("Watchdog: %s (pid %d) running", c->name, c->pid);
+        }
+        c->iterations = it;
+        c->last_progress = t;
+    }
+}
 
-    logger("Big brother Watchdog process is watching. PID: %d", getpid());
+static void load_deadlines(const newBlackboard *bb, ComponentMonitor *components) {
+    static const int defaults[WD_COMPONENTS] = WD_DEFAULT_DEADLINES_MS;
+    BBConfig cfg;
+    BB_READ(&bb->config, cfg);
+    for (int i = 0; i < WD_COMPONENTS; i++) {
+        int ms = cfg.wd_deadline_ms[i];
+        components[i].deadline_ms = (ms > 0) ? ms : defaults[i];
+    }
+}
 
-    ComponentMonitor components[] = {
-        {PIPE_BLACKBOARD,   open(PIPE_BLACKBOARD,   O_RDONLY | O_NONBLOCK), time(NULL)},
-        {PIPE_DYNAMICS,     open(PIPE_DYNAMICS,     O_RDONLY | O_NONBLOCK), time(NULL)},
-        {PIPE_KEYBOARD,     open(PIPE_KEYBOARD,     O_RDONLY | O_NONBLOCK), time(NULL)},
-        {PIPE_WINDOW,       open(PIPE_WINDOW,       O_RDONLY | O_NONBLOCK), time(NULL)},
-        {PIPE_OBSTACLE,     open(PIPE_OBSTACLE,     O_RDONLY | O_NONBLOCK), time(NULL)}, 
-        {PIPE_TARGET,       open(PIPE_TARGET,       O_RDONLY | O_NONBLOCK), time(NULL)}
-    };
+// Alive but not progressing, stopped, or gone? /proc tells us, only on alert.
+static char process_state(int pid) {
+    char path[64], buf[256];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return '?';
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    char *p = strrchr(buf, ')');     // the command name may contain spaces
+    return (p && p[1] == ' ') ? p[2] : '?';
+}
+
+#ifndef BB_ENGINE
+int main() {  // watchdog works and receives signals neglecting the state machine of the whole process. others have been implemented to send heartbeats whatever the state is.
+    int shm_fd = shm_open(SHM_NAME, O_RDONLY, 0666);
+    if (shm_fd == -1) {
+        perror("watchdog shm_open");
+        return 1;
+    }
+    newBlackboard *bb = mmap(NULL, sizeof(newBlackboard), PROT_READ, MAP_SHARED, shm_fd, 0);
+    if (bb == MAP_FAILED) {
+        perror("watchdog mmap");
+        return 1;
+    }
+    watchdog_run(bb, NULL);
+    // Only returns on an alert: master takes everything down.
+    munmap(bb, sizeof(newBlackboard));
+    kill(getppid(), SIGTERM);
+    exit(EXIT_FAILURE);
+}
+#endif
 
-    fd_set readfds;
-    struct timeval timeout;
+// Watches until a component is late, then returns EXIT_FAILURE. In the
+// engine that ends the thread, and master shuts the simulation down.
+int watchdog_run(newBlackboard *bb, sem_t *sem) {
+    logger("Big brother Watchdog process is watching. PID: %d", getpid());
 
-    while (1) {
-        FD_ZERO(&readfds);
-        int max_fd = 0;
-        time_t now = time(NULL);
+    ComponentMonitor components[WD_COMPONENTS];
+    long long start = monotonic_ns();
+    for (int i = 0; i < WD_COMPONENTS; i++) {
+        memset(&components[i], 0, sizeof(components[i]));
+        components[i].name = WD_NAMES[i];
+        components[i].last_progress = start;
+    }
+    unsigned int config_seen = seq_version(&bb->config.seq);
+    load_deadlines(bb, components);
+    for (int i = 0; i < WD_COMPONENTS; i++) {
+        logger("Watchdog: %s deadline %d ms", WD_NAMES[i], components[i].deadline_ms);
+    }
 
-        for (int i = 0; i < 6; i++) {
-            if (components[i].fd > 0) {
-                FD_SET(components[i].fd, &readfds);
-                if (components[i].fd > max_fd)
-                    max_fd = components[i].fd;
-            }
-        }
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        if (select(max_fd + 1, &readfds, NULL, NULL, &timeout) < 0) {
-            perror("watchdog select failed");
-            break;
+    // Nothing wakes us up: we sleep until the earliest moment a component
+    // could be late, sample the table and either find it moved on (sleep
+    // again) or raise the alert.
+    int alert = -1;
+    while (alert < 0) {
+        long long now = monotonic_ns();
+        if (seq_version(&bb->config.seq) != config_seen) {
+            config_seen = seq_version(&bb->config.seq);
+            load_deadlines(bb, components);
         }
-        for (int i = 0; i < 6; i++) {
-            if (FD_ISSET(components[i].fd, &readfds)) {
-                int len;
-                char buffer[16];
-                while ((len = read(components[i].fd, buffer, sizeof(buffer) - 1)) > 0) {
-                    buffer[len] = '\0';                         // make read buffer a valid C-string for logging
-                    components[i].last_heartbeat = time(NULL);   // heartbeat received -> update last seen time
-                    logger("Watchdog received: %s from %s", buffer, components[i].pipe_name);
-                }
-            }
-            if (difftime(now, components[i].last_heartbeat) > TIMEOUT_SECONDS) {
-                fprintf(stderr, "Watchdog ALERT: No heartbeat from %s!\n", components[i].pipe_name);
-                logger("Watchdog ALERT: No heartbeat from %s!\n", components[i].pipe_name);
-                for (int i = 0; i < 6; i++) {
-                    if (components[i].fd > 0) {
-                        close(components[i].fd);
-                    }
-                }
-                kill(getppid(), SIGTERM);
-                exit(EXIT_FAILURE);
+        long long next = now + WD_MAX_SLEEP_MS * 1000000LL;
+        for (int i = 0; i < WD_COMPONENTS; i++) {
+            sample(bb, &components[i], i);
+            long long expiry = expiry_of(&components[i]);
+            if (expiry < 0) continue;
+            if (now > expiry) {
+                alert = i;
+                break;
             }
+            if (expiry < next) next = expiry;
         }
-        sleep(WATCHDOG_HEARTBEAT_DELAY);
-    }
-    for (int i = 0; i < 6; i++) {
-        if (components[i].fd > 0) {
-            close(components[i].fd);
-        }
+        if (alert >= 0) break;
+        next += 1;    // strictly past the expiry
+        struct timespec ts = { (time_t)(next / 1000000000LL), (long)(next % 1000000000LL) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
     }
 
-    return 0;
+    ComponentMonitor *c = &components[alert];
+    long long late = monotonic_ns() - c->last_progress;
+    char state = (c->pid > 0) ? process_state(c->pid) : '?';
+    fprintf(stderr, "Watchdog ALERT: No heartbeat from %s!\n", c->name);
+    log_at(LOG_ERROR, "Watchdog ALERT: %s (pid %d, state %c) made no progress for %.1f ms (deadline %d ms, %llu iterations)!",
+                      c->name, c->pid, state, late / 1e6, c->deadline_ms, c->iterations);
+    return EXIT_FAILURE;
 }
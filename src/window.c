@@ -14,6 +14,7 @@
 #include <time.h>
 #include <math.h>
 #include "blackboard.h"
+#include "object_pool.h"
 
 
 
@@ -33,14 +34,93 @@ static inline int scale_axis(int v, int src_lo, int src_hi, int dst_lo, int dst_
     return clampi(out, dst_lo, dst_hi);
 }
 
-void render_loading(WINDOW *win);
-void render_game(WINDOW *win, newBlackboard *bb);
-void render_visualization(WINDOW * win, newBlackboard * bb);
+// What is on the screen, so a frame only touches what changed: the play area
+// cell by cell, the inspection panel line by line. ncurses would find the
+// differences on its own at refresh time, but only after we erased and redrew
+// the whole window into it every frame; now unchanged cells are never written,
+// and everything goes out in one doupdate() per frame. The border, the panel
+// separator and the loading screen are drawn only when the layout changes.
+#define PANEL_LINES 6
+enum { LAYOUT_NONE, LAYOUT_LOADING, LAYOUT_GAME };
+
+typedef struct {
+    WINDOW *win;
+    int layout;
+    int h, w;               // window size the layout was drawn at
+    int split_x;            // first column of the inspection panel (= play area width)
+    int cap;
+    chtype *cells;          // play area as it is on the screen, h*w
+    chtype *next;           // the frame being built
+    char panel[PANEL_LINES][64];
+} Frame;
+
+// What a frame shows, taken out of the blackboard before any ncurses call:
+// a few hundred bytes instead of a copy of the whole blackboard, and the
+// sections behind it are copied only when their version moved. Terminal I/O
+// only ever sees this.
+typedef struct {
+    int state;
+    int max_height;
+    int drone_x, drone_y;
+    Stats stats;
+    double score;
+    int force_x, force_y;
+    int remote_x, remote_y;         // already smoothed through the jitter buffer
+    int n_peers;
+    int peer_xs[NET_MAX_PEERS], peer_ys[NET_MAX_PEERS];
+} RenderView;
+
+typedef struct {                    // our copies of the sections a frame is made of
+    BBConfig config;
+    BBInput input;
+    BBDrone drone;
+    BBNet net;
+    BBQuit quit;
+    unsigned int config_seen, input_seen, drone_seen, net_seen, quit_seen;
+} RenderSource;
+
+void render_loading(WINDOW *win, Frame *fr);
+void render_game(WINDOW *win, const RenderView *v, const ObjectList objs[OBJ_KINDS], Frame *fr);
+void render_visualization(WINDOW * win, const RenderView *v, const ObjectList objs[OBJ_KINDS], Frame *fr);
+
+static void render_view_read(const newBlackboard *bb, RenderSource *src, int max_height, RenderView *v) {
+    BB_READ_IF_CHANGED(&bb->config, src->config, src->config_seen);
+    BB_READ_IF_CHANGED(&bb->input, src->input, src->input_seen);
+    BB_READ_IF_CHANGED(&bb->drone, src->drone, src->drone_seen);
+    BB_READ_IF_CHANGED(&bb->net, src->net, src->net_seen);
+    BB_READ_IF_CHANGED(&bb->quit, src->quit, src->quit_seen);
+
+    memset(v, 0, sizeof(*v));       // compared with memcmp, padding included
+    v->state = src->quit.requested ? 2 : src->input.state;
+    v->max_height = max_height;
+    v->drone_x = src->drone.drone_x;
+    v->drone_y = src->drone.drone_y;
+    v->stats = src->drone.stats;
+    v->score = src->config.score;
+    v->force_x = src->input.command_force_x;
+    v->force_y = src->input.command_force_y;
+
+    // Assignment 3: the remote peer drone (client side), smoothed through the
+    // jitter buffer rather than jumping between states.
+    v->remote_x = src->net.remote_drone_x;
+    v->remote_y = src->net.remote_drone_y;
+    double fx, fy;
+    if (bb_remote_at(&src->net, monotonic_ns() - src->config.net_interp_delay_ms * 1000000LL, &fx, &fy)) {
+        v->remote_x = (int)lround(fx);
+        v->remote_y = (int)lround(fy);
+    }
+    v->n_peers = (src->net.n_peers < NET_MAX_PEERS) ? src->net.n_peers : NET_MAX_PEERS;
+    for (int i = 0; i < v->n_peers; i++) {
+        v->peer_xs[i] = src->net.peer_xs[i];
+        v->peer_ys[i] = src->net.peer_ys[i];
+    }
+}
 
 /* Draw a border around the actual simulation world (bb->max_width x bb->max_height),
    so it's visually clear where the drone is allowed to move. */
 void draw_world_border(WINDOW *win, int top, int left, int h, int w);
 
+#ifndef BB_ENGINE
 int main(int argc, char *argv[]) {
     int shm_fd = shm_open(SHM_NAME, O_RDWR, 0666);
     if (shm_fd == -1) {
@@ -52,12 +132,20 @@ int main(int argc, char *argv[]) {
         perror("mmap failed");
         return 1;
     }
-    sem_t *sem = sem_open(SEM_NAME, 0);
-    if (sem == SEM_FAILED) {
-        perror("sem_open failed");
+    int rc = window_run(bb, NULL);
+    munmap(bb, sizeof(newBlackboard));
+    return rc;
+}
+#endif
+
+int window_run(newBlackboard *bb, sem_t *sem) {
+    ObjectPool pool;
+    if (pool_open(&pool, bb) == -1) {
+        perror("object pool open failed");
         return 1;
     }
-    int fd = open_watchdog_pipe(PIPE_WINDOW);
+    Heartbeat hb;
+    heartbeat_open(&hb, bb, WD_WINDOW);
     logger("Window process started. PID: %d", getpid());
 
     // close(STDIN_FILENO); // close stdin to avoid keyboard input
@@ -76,10 +164,14 @@ int main(int argc, char *argv[]) {
     int env_lock = (getenv("BB_LOCK_SIZE") != NULL);
     WINDOW *frame = NULL;
     if (env_lock) {
-        sem_wait(sem);
-        int h = bb->max_height;
-        int w = bb->max_width;
-        sem_post(sem);
+        // The server's size from the handshake; until it came (master gave up
+        // waiting) whatever the world says.
+        BBWorld world;
+        BBNet net;
+        BB_READ(&bb->world, world);
+        BB_READ(&bb->net, net);
+        int h = (net.net_height > 0) ? net.net_height : world.max_height;
+        int w = (net.net_width > 0) ? net.net_width : world.max_width;
 
         // A bit of sanity so we don't wait forever on garbage values.
         if (h < 5 || w < 10) {
@@ -140,135 +232,265 @@ frame = newwin(draw_h, draw_w, 0, 0);
     curs_set(0);
     wrefresh(stdscr);
     
-    time_t now = time(NULL);
+    static RenderSource src;
+    src.config_seen = src.input_seen = src.drone_seen = src.net_seen = src.quit_seen = ~0u;
+    RenderView view, shown;
+    int shown_h = -1, shown_w = -1;
+    static ObjectList objs[OBJ_KINDS];
+    for (int kind = 0; kind < OBJ_KINDS; kind++) object_list_init(&objs[kind]);
+    unsigned int hits_seen = ~0u;
+    static Frame fr;
+    // Frame pacing: a frame that took more than half of its slot (slow
+    // terminal, saturated SSH link) stretches the period, so frames are
+    // dropped instead of piling up in the tty; fast frames bring it back.
+    long long period = RENDER_DELAY * 1000LL;
+    long long dropped = 0;
+#ifdef BB_ENGINE
+    set_escdelay(25);   // ESC quits: don't stall a frame (and the watchdog) waiting for a sequence
+#endif
     while (1){
-        sem_wait(sem);
-        int lock_size = env_lock || bb->net_lock_size;
-        if (!lock_size) {
-            getmaxyx(stdscr, bb->max_height, bb->max_width);
+        long long t0 = monotonic_ns();
+        // We own bb->world, so publishing the terminal size is a lock-free
+        // seqlock write (and only when it actually changed). A client takes
+        // the server's size from the handshake instead. Everything else
+        // is copied into a RenderView first: no ncurses call ever runs while
+        // we are looking at shared memory, Dynamics is never kept waiting.
+        int cur_h, cur_w;
+        getmaxyx(stdscr, cur_h, cur_w);
+        BBWorld world;
+        BB_READ(&bb->world, world);
+        BB_READ_IF_CHANGED(&bb->net, src.net, src.net_seen);
+        int lock_size = env_lock || src.net.net_lock_size;
+        int want_h = cur_h, want_w = cur_w;
+        if (src.net.net_width > 0 && src.net.net_height > 0) {
+            want_h = src.net.net_height;
+            want_w = src.net.net_width;
+            lock_size = 0;      // the server's size is the one to publish, whatever the terminal says
         }
-        bb->win_ready = 1;
-
-        WINDOW *win = frame ? frame : stdscr;
-        if (bb->state == 0){
-            render_loading(win);
-        } else {
-            bb->stats.time_elapsed += RENDER_DELAY/1000000.0;
+        int resized = !lock_size && (world.max_height != want_h || world.max_width != want_w);
+        if (resized || !world.win_ready) {
+            BB_WRITE_BEGIN(&bb->world);
+            if (!lock_size) {
+                bb->world.max_height = want_h;
+                bb->world.max_width = want_w;
+            }
+            bb->world.win_ready = 1;
+            BB_WRITE_END(&bb->world);
+            BB_READ(&bb->world, world);
         }
-        if (bb->state == 1){
-            render_game(win, bb);
+        // Objects are copied out of the pool only when a generator published a new set.
+        int dirty = 0;
+        for (int kind = 0; kind < OBJ_KINDS; kind++) {
+            int rc = pool_read_objects(&pool, bb, kind, &objs[kind]);
+            if (rc == -1) {
+                log_at(LOG_WARN, "Window: object pool read failed");
+            } else if (rc == 1) {
+                hits_seen = ~0u;
+                dirty = 1;
+            }
         }
-        if (bb->state == 2){
+        dirty |= pool_read_hits(&pool, bb, objs, &hits_seen);
+        render_view_read(bb, &src, world.max_height, &view);
+        if (view.state == 2){
             // char text [30];
             // logger(sprintf(text, "Final score %.2f\n",  bb->score));
             break;
         }
-        if (bb->state == 3){
-            render_visualization(win, bb);
-        }
-        sem_post(sem);
-        if (difftime(time(NULL), now) >= 3){
-            send_heartbeat(fd);
-            now = time(NULL);
+
+        // Nothing new (a paused game, the loading screen): no frame at all.
+        WINDOW *win = frame ? frame : stdscr;
+        int wh, ww;
+        getmaxyx(win, wh, ww);
+        dirty |= wh != shown_h || ww != shown_w || memcmp(&view, &shown, sizeof(view)) != 0;
+        if (dirty) {
+            if (view.state == 0){
+                render_loading(win, &fr);
+            }
+            if (view.state == 1){
+                render_game(win, &view, objs, &fr);
+            }
+            if (view.state == 3){
+                render_visualization(win, &view, objs, &fr);
+            }
+            doupdate();     // the frame's changes, in one write
+            shown = view;
+            shown_h = wh;
+            shown_w = ww;
+
+            long long cost = monotonic_ns() - t0;
+            long long was = period;
+            if (cost * 2 > period) {
+                period = (cost * 2 < RENDER_MAX_DELAY * 1000LL) ? cost * 2 : RENDER_MAX_DELAY * 1000LL;
+            } else if (period > RENDER_DELAY * 1000LL) {
+                period = (period * 3 / 4 > RENDER_DELAY * 1000LL) ? period * 3 / 4 : RENDER_DELAY * 1000LL;
+            }
+            dropped += period / (RENDER_DELAY * 1000LL) - 1;
+            if (was == RENDER_DELAY * 1000LL && period > was) {
+                logger("Window: frame took %lld ms, slowing down to one frame every %lld ms", cost / 1000000, period / 1000000);
+            } else if (was > RENDER_DELAY * 1000LL && period == RENDER_DELAY * 1000LL) {
+                logger("Window: terminal caught up, %lld frames dropped", dropped);
+                dropped = 0;
+            }
         }
-        usleep(RENDER_DELAY);
+        heartbeat_tick(&hb);
+
+        long long wait = t0 + period - monotonic_ns();
+        if (wait < 0) wait = 0;
+#ifdef BB_ENGINE
+        // Wait for the next frame on the keyboard instead of sleeping; a key
+        // is handled right away (and redraws early).
+        wtimeout(stdscr, (int)(wait / 1000000));
+        int ch = getch();
+        if (ch != ERR && ch != KEY_RESIZE && keyboard_key(bb, ch)) break;   // the engine has no Keyboard terminal, we take its keys
+#else
+        usleep(wait / 1000);
+#endif
     }
 
-    if (fd >= 0) { close(fd); }
+    heartbeat_close(&hb);
     if (frame) delwin(frame);
     endwin();
-    sem_close(sem);
-    munmap(bb, sizeof(newBlackboard));
+    free(fr.cells);
+    free(fr.next);
+    pool_close(&pool);
 
     return 0;
 }
 
-void render_loading(WINDOW *win){
-    werase(win);
+void render_loading(WINDOW *win, Frame *fr){
     int h, w;
     getmaxyx(win, h, w);
+    if (fr->win == win && fr->layout == LAYOUT_LOADING && fr->h == h && fr->w == w) return;    // still on screen
+    werase(win);
     wattron(win, A_BOLD | A_BLINK);
     const char *text = "DRONE SIMULATOR 101";
     mvwprintw(win, h/2, (w - (int)strlen(text))/2, "%s", text);
     wattroff(win, A_BOLD | A_BLINK);
     box(win, 0, 0);
-    wrefresh(win);
+    wnoutrefresh(win);
+    fr->win = win;
+    fr->layout = LAYOUT_LOADING;
+    fr->h = h;
+    fr->w = w;
 }
 
-void render_game(WINDOW * win, newBlackboard *bb){
+// Starts over on a new layout or size: border, separator, empty play area.
+// Returns -1 if the cell buffers can't be had.
+static int frame_layout(WINDOW *win, Frame *fr, int wh, int ww, int split_x) {
+    if (fr->win == win && fr->layout == LAYOUT_GAME && fr->h == wh && fr->w == ww && fr->split_x == split_x) return 0;
+    if (wh * ww > fr->cap) {
+        chtype *cells = realloc(fr->cells, sizeof(chtype) * wh * ww);
+        if (cells) fr->cells = cells;
+        chtype *next = realloc(fr->next, sizeof(chtype) * wh * ww);
+        if (next) fr->next = next;
+        if (!cells || !next) {
+            fr->layout = LAYOUT_NONE;
+            return -1;
+        }
+        fr->cap = wh * ww;
+    }
     werase(win);
     box(win, 0, 0);
+    if (split_x < ww - 1) {
+        for (int y = 1; y < wh - 1; y++) {
+            mvwaddch(win, y, split_x, ACS_VLINE);
+        }
+    }
+    for (int k = 0; k < wh * ww; k++) fr->cells[k] = ' ';
+    memset(fr->panel, 0, sizeof(fr->panel));
+    fr->win = win;
+    fr->layout = LAYOUT_GAME;
+    fr->h = wh;
+    fr->w = ww;
+    fr->split_x = split_x;
+    return 0;
+}
+
+static void frame_put(Frame *fr, int y, int x, chtype ch) {
+    if (x < 1 || y < 1 || x >= fr->split_x || y >= fr->h - 1) return;    // only inside the play area
+    fr->next[y * fr->w + x] = ch;
+}
 
+// Builds the play area of this frame into fr->next, in the order things
+// overlap: objects, remote drones, our drone on top.
+static void frame_build(Frame *fr, const RenderView *v, const ObjectList objs[OBJ_KINDS], int map) {
+    for (int y = 1; y < fr->h - 1; y++) {
+        for (int x = 1; x < fr->split_x; x++) fr->next[y * fr->w + x] = ' ';
+    }
+
+    const ObjectList *obst = &objs[OBJ_OBSTACLES];
+    for (int i = 0; i < obst->count; i++){
+        if (!object_alive(obst, i) || obst->ys[i] >= v->max_height){   // wont break bc if drone hits one, it is masked in the hit mask
+            continue;
+        }
+        frame_put(fr, obst->ys[i], obst->xs[i], 'O'|COLOR_PAIR(3));
+    }
+    const ObjectList *targ = &objs[OBJ_TARGETS];
+    for (int i = 0; i < targ->count; i++){
+        if (!object_alive(targ, i) || targ->ys[i] >= v->max_height){
+            continue;
+        }
+        frame_put(fr, targ->ys[i], targ->xs[i], 'T'|COLOR_PAIR(2));
+    }
+
+    // Assignment 3: show the remote peer drone (client side) if available...
+    if (v->remote_y < v->max_height) frame_put(fr, v->remote_y, v->remote_x, 'X'|A_BOLD|COLOR_PAIR(4));
+    // ...and the other clients of a swarm session.
+    for (int i = 0; i < v->n_peers; i++) {
+        if (v->peer_ys[i] < v->max_height) frame_put(fr, v->peer_ys[i], v->peer_xs[i], 'x'|COLOR_PAIR(4));
+    }
+    // A tiny "map" view. Nothing fancy, just so the (M) toggle still does something.
+    frame_put(fr, v->drone_y, v->drone_x, map ? ','|COLOR_PAIR(4) : 'D'|A_BOLD|COLOR_PAIR(1));
+}
+
+static void render_frame(WINDOW *win, const RenderView *v, const ObjectList objs[OBJ_KINDS], Frame *fr, int map) {
     int wh, ww;
     getmaxyx(win, wh, ww);
 
-    // Server uses bb->max_* for physics + networking conversion.
-    // For *rendering* we may be smaller (client terminal), so we scale to fit ww/wh.
-    int server_h = bb->max_height;
-    int server_w = bb->max_width;
-    int server_insp = bb_inspection_width(bb);
-    int server_play = bb_play_width(bb);
-
     // Decide inspection panel for *this* window size.
     int insp_w = (ww < INSPECTION_WIDTH + 20) ? 0 : INSPECTION_WIDTH;
     int play_w = ww - insp_w;
     if (play_w < 10) { insp_w = 0; play_w = ww; }
 
     int split_x = play_w; // first column of the inspection panel (screen coords)
-
-if (insp_w > 0 && split_x > 0 && split_x < ww - 1) {
-        for (int y = 1; y < wh - 1; y++) {
-            mvwaddch(win, y, split_x, ACS_VLINE);
+    if (frame_layout(win, fr, wh, ww, split_x) == -1) return;   // out of memory: the screen keeps its last frame
+
+    frame_build(fr, v, objs, map);
+    for (int y = 1; y < wh - 1; y++) {
+        for (int x = 1; x < split_x; x++) {
+            int k = y * ww + x;
+            if (fr->next[k] == fr->cells[k]) continue;
+            mvwaddch(win, y, x, fr->next[k]);
+            fr->cells[k] = fr->next[k];
         }
-
-        int px = split_x + 2;
-        int py = 1;
-        mvwprintw(win, py++, px, "Time:  %.1f", bb->stats.time_elapsed);
-        mvwprintw(win, py++, px, "Score: %.2f", bb->score);
-        py++;
-        mvwprintw(win, py++, px, "Hits O: %d", bb->stats.hit_obstacles);
-        mvwprintw(win, py++, px, "Hits T: %d", bb->stats.hit_targets);
-        py++;
-        mvwprintw(win, py++, px, "Force: (%d,%d)", bb->command_force_x, bb->command_force_y);
-        py++;
-        mvwprintw(win, py++, px, "Keys: I start, Y reset");
     }
 
-    for (int i = 0; i < bb->n_obstacles; i++){
-        if (bb->obstacle_xs[i] < 1 || bb->obstacle_ys[i] < 1){
-            continue;                                                                       // wont break bc if drone hits one, that index becomes -1
-        }
-        if (bb->obstacle_xs[i] >= split_x || bb->obstacle_ys[i] >= bb->max_height){     // published obstacles are out of bounds
-            continue;
-        }
-        mvwaddch(win, bb->obstacle_ys[i], bb->obstacle_xs[i], 'O'|COLOR_PAIR(3));
-    }
-    for (int i = 0; i < bb->n_targets; i++){
-        if (bb->target_xs[i] < 1 || bb->target_ys[i] < 1){
-            continue;                                                                       // wont break bc if drone hits one, that index becomes -1
-        }
-        if (bb->target_xs[i] >= split_x || bb->target_ys[i] >= bb->max_height){         // published targets are out of bounds
-            continue;
+    if (insp_w > 0 && split_x > 0 && split_x < ww - 1) {
+        static const int rows[PANEL_LINES] = { 1, 2, 4, 5, 7, 9 };
+        char line[PANEL_LINES][64];
+        snprintf(line[0], sizeof(line[0]), "Time:  %.1f", v->stats.time_elapsed);
+        snprintf(line[1], sizeof(line[1]), "Score: %.2f", v->score);
+        snprintf(line[2], sizeof(line[2]), "Hits O: %d", v->stats.hit_obstacles);
+        snprintf(line[3], sizeof(line[3]), "Hits T: %d", v->stats.hit_targets);
+        snprintf(line[4], sizeof(line[4]), "Force: (%d,%d)", v->force_x, v->force_y);
+        snprintf(line[5], sizeof(line[5]), "Keys: I start, Y reset");
+        int px = split_x + 2;
+        int room = ww - 1 - px;     // up to the right border
+        for (int i = 0; i < PANEL_LINES && rows[i] < wh - 1; i++) {
+            if (strcmp(line[i], fr->panel[i]) == 0) continue;
+            mvwprintw(win, rows[i], px, "%-*.*s", room, room, line[i]);    // padded: a shorter text wipes the old one
+            strcpy(fr->panel[i], line[i]);
         }
-        mvwaddch(win, bb->target_ys[i], bb->target_xs[i], 'T'|COLOR_PAIR(2));
     }
+    wnoutrefresh(win);
+}
 
-    // Assignment 3: show the remote peer drone (client side) if available.
-    if (bb->remote_drone_x > 0 && bb->remote_drone_y > 0 &&
-        bb->remote_drone_x < split_x && bb->remote_drone_y < bb->max_height) {
-        mvwaddch(win, bb->remote_drone_y, bb->remote_drone_x, 'X'|A_BOLD|COLOR_PAIR(4));
-    }
-    mvwaddch(win, bb->drone_y, bb->drone_x, 'D'|A_BOLD|COLOR_PAIR(1));
-    wrefresh(win);
+void render_game(WINDOW * win, const RenderView *v, const ObjectList objs[OBJ_KINDS], Frame *fr){
+    render_frame(win, v, objs, fr, 0);
 }
 
-void render_visualization(WINDOW * win, newBlackboard * bb){
-    // A tiny "map" view. Nothing fancy, just so the (M) toggle still does something.
-    render_game(win, bb);
-    if (bb->drone_x > 0 && bb->drone_y > 0) {
-        mvwaddch(win, bb->drone_y, bb->drone_x, ','|COLOR_PAIR(4));
-    }
-    wrefresh(win);
+void render_visualization(WINDOW * win, const RenderView *v, const ObjectList objs[OBJ_KINDS], Frame *fr){
+    render_frame(win, v, objs, fr, 1);
 }
 
 void draw_world_border(WINDOW *win, int top, int left, int h, int w) {